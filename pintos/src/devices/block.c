@@ -139,6 +139,31 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   block->write_cnt++;
 }
 
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK.
+   Sector SECTOR + i is written from BUFFERS[i], which must
+   contain BLOCK_SECTOR_SIZE bytes.  If the driver supports it,
+   the sectors are written in a single transfer, otherwise one
+   at a time.  Returns after the block device has acknowledged
+   receiving all of the data. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      const void **buffers, size_t cnt)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, buffers, cnt);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->write (block->aux, sector + i, buffers[i]);
+  block->write_cnt += cnt;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
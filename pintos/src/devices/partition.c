@@ -317,8 +317,19 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Writes CNT consecutive sectors starting at SECTOR to partition
+   P from BUFFERS. */
+static void
+partition_write_multiple (void *p_, block_sector_t sector,
+                          const void **buffers, size_t cnt)
+{
+  struct partition *p = p_;
+  block_write_multiple (p->block, p->start + sector, buffers, cnt);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_write_multiple
   };
@@ -125,6 +125,7 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  bc_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
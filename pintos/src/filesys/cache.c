@@ -1,58 +1,509 @@
 #include "filesys/cache.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "devices/block.h"
+#include "devices/timer.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "lib/string.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/syscall.h"
 
-#define CACHE_SECTOR_NUMBER 64
+/* # of cache entries sharing one page of cache memory. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 
-/* buffer cache entry's structure */
-struct cache_entry buffer_cache[CACHE_SECTOR_NUMBER];
+/* Buffer cache never shrinks below this many pages. */
+#define CACHE_MIN_PAGES 4
 
-/* Initialize buffer cache. Allocate 32KB cache memory and match it with
-	 each entry. If fail to allocate, exit(-1). Called in threads/init.c */
+/* Max number of entries one thread keeps pinned at once: an index table
+   held by an append cursor, the double indirect table and a new table
+   while moving it, and one more pinned by a page fault taken while
+   copying to or from user memory. */
+#define PIN_DEPTH_MAX 4
+
+/* Max number of dirty entries written back by one flusher wake-up. A run
+   of consecutive sectors is not cut at this limit. */
+#define FLUSH_BATCH 8
+
+/* Max number of dirty neighbours written back together with a dirty
+   victim. */
+#define FLUSH_RUN_MAX 64
+
+/* 2Q queue sizes. A1in holds sectors referenced once, A1out remembers
+   sectors recently evicted from A1in. */
+#define TWOQ_KIN (bc_entry_cnt / 4)
+#define TWOQ_KOUT (bc_entry_cnt / 2)
+
+/* Max number of sectors waiting for read-ahead. */
+#define READ_AHEAD_QUEUE 32
+
+/* Interval of write-behind flusher in milliseconds. */
+unsigned bc_flush_interval = 1000;
+
+/* Number of sectors buffer cache holds when memory is not short. */
+size_t bc_size = 64;
+
+/* buffer cache entry's structure. bc_entry_cnt entries. */
+static struct cache_entry *buffer_cache;
+static int bc_entry_cnt;
+
+/* Cache memory. Page i holds data of entries i * SECTORS_PER_PAGE to
+   (i + 1) * SECTORS_PER_PAGE - 1, or is a null pointer if the page was given
+   back to user pool. Entries of such page are offline: their cache_addr is
+   a null pointer and they are not in free entry list. */
+static void **bc_pages;
+static int bc_page_cnt;
+static int bc_online_pages;
+
+/* Time of last failure to grow buffer cache. Growing is retried at most
+   once per second. */
+static int64_t bc_grow_fail;
+
+/* Statistics, protected by bc_lock. entry_cnt is filled on demand. */
+static struct cache_stat bc_stat;
+
+/* Scratch arrays for write-back, bc_entry_cnt elements each, protected by
+   flush_lock. flush_idx holds indexes of entries to write back, flush_bufs
+   their cache_addr in sector order. */
+static int *flush_idx;
+static const void **flush_bufs;
+
+/* Sector after the last one written by flusher. Flusher sweeps dirty
+   sectors upward from here, like an elevator. */
+static block_sector_t flush_pos;
+
+/* Index from disk sector to the cache entry holding it, so that lookup
+   does not have to scan every entry. */
+static struct hash cache_index;
+
+/* List of empty cache entries. */
+static struct list free_entries;
+
+/* Lock for buffer cache. Protects cache entries' metadata, cache index and
+   free entry list. Data is copied to/from caller's buffer without this
+   lock, because caller's buffer may be user memory and can page fault.
+   Disk I/O is done without this lock too: entry being read or written
+   back is pinned, so that it keeps its sector. An entry's io_lock is held
+   while it is loaded, and threads hitting it wait on io_lock. */
+static struct lock bc_lock;
+
+/* Serializes write-backs, and protects flush_idx, flush_bufs and
+   flush_pos. Acquired before bc_lock. */
+static struct lock flush_lock;
+
+/* Signaled when an entry gets unpinned. */
+static struct condition bc_unpinned;
+
+/* Threads holding pins, each PIN_DEPTH_MAX at most. A thread takes a slot
+   before its first pin and gives it back with its last, so that fewer
+   entries than CACHE_MIN_PAGES holds are ever pinned by threads, and a
+   thread waiting for an unpinned entry cannot wait forever on others that
+   wait too. Entries pinned by flush_entries() are not counted, since they
+   are unpinned once written without waiting for other entries. */
+static struct semaphore pin_slots;
+
+/* False after bc_exit(). Tells flusher and read-ahead threads to stop. */
+static bool bc_running;
+
+/* Circular queue of sectors to be read ahead, protected by ra_lock.
+   Read-ahead thread waits on ra_cond while queue is empty. */
+static block_sector_t ra_queue[READ_AHEAD_QUEUE];
+static int ra_head, ra_cnt;
+static struct lock ra_lock;
+static struct condition ra_cond;
+
+/* Buffer cache replacement policy. All functions are called with bc_lock
+   held. */
+struct bc_policy
+  {
+    const char *name;                           /* Name in "-bcpolicy". */
+    void (*init) (void);                        /* Initialize. */
+    void (*insert) (struct cache_entry *);      /* Entry got a sector. */
+    void (*access) (struct cache_entry *);      /* Entry was read/written. */
+    void (*remove) (struct cache_entry *);      /* Entry becomes empty. */
+    struct cache_entry *(*victim) (void);       /* Unpinned entry to evict. */
+  };
+
+static const struct bc_policy *bc_policy;
+
+/* Function prototypes */
+static unsigned bc_hash_func (const struct hash_elem *, void *);
+static bool bc_less_func (const struct hash_elem *,
+                          const struct hash_elem *, void *);
+static void bc_flusher (void *);
+static void bc_read_aheader (void *);
+static int alloc_cache_entry (block_sector_t);
+static bool bc_grow (void);
+static void release_cache_entry (int);
+static void sort_by_sector (int *, int);
+static void flush_entries (int *, int);
+static void flush_run (int);
+static void pin_enter (void);
+static void pin_leave (void);
+
+/* Initialize buffer cache of bc_size sectors. Cache memory is taken from
+   user pool page by page, so that it can be given back when user memory is
+   short (see bc_shrink()). If even one page cannot be allocated, panic.
+   Called in filesys/filesys.c */
 void
 bc_init(void)
 {
   int i;
-  for (i=0; i < CACHE_SECTOR_NUMBER; i++){
-    void *caddr = malloc(BLOCK_SECTOR_SIZE);
-    if (caddr == NULL) {
-      exit(-1);
-    }
+  if (!hash_init(&cache_index, bc_hash_func, bc_less_func, NULL))
+    exit(-1);
+  list_init(&free_entries);
+  lock_init(&bc_lock);
+  lock_init(&flush_lock);
+  cond_init(&bc_unpinned);
+  sema_init(&pin_slots,
+            (CACHE_MIN_PAGES * SECTORS_PER_PAGE - 1) / PIN_DEPTH_MAX);
+  lock_init(&ra_lock);
+  cond_init(&ra_cond);
+
+  bc_page_cnt = DIV_ROUND_UP(bc_size, SECTORS_PER_PAGE);
+  if (bc_page_cnt < CACHE_MIN_PAGES)
+    bc_page_cnt = CACHE_MIN_PAGES;
+  bc_entry_cnt = bc_page_cnt * SECTORS_PER_PAGE;
+  buffer_cache = malloc(bc_entry_cnt * sizeof *buffer_cache);
+  bc_pages = calloc(bc_page_cnt, sizeof *bc_pages);
+  flush_idx = malloc(bc_entry_cnt * sizeof *flush_idx);
+  flush_bufs = malloc(bc_entry_cnt * sizeof *flush_bufs);
+  if (buffer_cache == NULL || bc_pages == NULL || flush_idx == NULL
+      || flush_bufs == NULL)
+    PANIC ("buffer cache allocation failed");
+
+  for (i=0; i < bc_entry_cnt; i++){
     buffer_cache[i].isempty = true;
     buffer_cache[i].isdirty = false;
     buffer_cache[i].clock = false;
-    buffer_cache[i].cache_addr = caddr;
+    buffer_cache[i].pinned = 0;
+    lock_init(&buffer_cache[i].io_lock);
+    buffer_cache[i].cache_addr = NULL;
     buffer_cache[i].sector = 0;
   }
+  if (bc_policy == NULL)
+    bc_set_policy("clock");
+  bc_policy->init();
+
+  bc_online_pages = 0;
+  while (bc_online_pages < bc_page_cnt && bc_grow())
+    continue;
+  if (bc_online_pages < CACHE_MIN_PAGES)
+    PANIC ("buffer cache allocation failed");
+  bc_running = true;
+
+  /* Start write-behind flusher thread. */
+  if (bc_flush_interval > 0)
+    thread_create("bc_flusher", PRI_DEFAULT, bc_flusher, NULL);
+
+  /* Start read-ahead thread. */
+  thread_create("bc_read_ahead", PRI_DEFAULT, bc_read_aheader, NULL);
 }
 
 /* Destory buffer cache. Scan cache_entries, if entry is dirty, flush it
-	 to Disk. Free all the memory spaces allocated for buffer cache. */
+	 to Disk. Free all the memory spaces allocated for buffer cache after
+   I/O in progress is done. */
 void
 bc_exit(void)
 {
+  int i;
+
+  lock_acquire(&bc_lock);
+  bc_running = false;
+  lock_release(&bc_lock);
+
   bc_flush_all();
 
-  int i;
-  for(i=0; i < CACHE_SECTOR_NUMBER; i++){
-    free(buffer_cache[i].cache_addr);
+  lock_acquire(&bc_lock);
+  for (i = 0; i < bc_entry_cnt; i++)
+    while (buffer_cache[i].pinned > 0)
+      cond_wait(&bc_unpinned, &bc_lock);
+  for(i=0; i < bc_page_cnt; i++){
+    if (bc_pages[i] != NULL)
+      palloc_free_page(bc_pages[i]);
+  }
+  free(bc_pages);
+  free(buffer_cache);
+  free(flush_idx);
+  free(flush_bufs);
+  hash_destroy(&cache_index, NULL);
+  lock_release(&bc_lock);
+}
+
+/* Add one page of memory to buffer cache, and put its entries in free
+   entry list. Page is taken from user pool, so it can be given back by
+   bc_shrink() when user memory is short. Return false if cache already has
+   bc_page_cnt pages or no free page exists. Must be called with bc_lock
+   held (or from bc_init). */
+static bool
+bc_grow (void)
+{
+  int i, j;
+  if (bc_online_pages >= bc_page_cnt)
+    return false;
+  for (i = 0; bc_pages[i] != NULL; i++)
+    continue;
+
+  void *page = palloc_get_page(PAL_USER);
+  if (page == NULL) {
+    bc_grow_fail = timer_ticks();
+    return false;
+  }
+  bc_pages[i] = page;
+  bc_online_pages++;
+  for (j = 0; j < SECTORS_PER_PAGE; j++) {
+    struct cache_entry *ce = &buffer_cache[i * SECTORS_PER_PAGE + j];
+    ce->cache_addr = (uint8_t *) page + j * BLOCK_SECTOR_SIZE;
+    list_push_back(&free_entries, &ce->free_elem);
+  }
+  return true;
+}
+
+/* Give one page of cache memory back to user pool, to relieve memory
+   pressure. Called by get_page() before it swaps out a user page.
+   Entries of the page are written back if dirty and dropped. The page is
+   chosen from the end, skipping pages with pinned entries. Cache keeps at
+   least CACHE_MIN_PAGES pages. Return true if a page was freed. It grows
+   back in alloc_cache_entry() when free memory is available again. */
+bool
+bc_shrink (void)
+{
+  int i, j, tries;
+  bool success = false;
+
+  lock_acquire(&flush_lock);
+  lock_acquire(&bc_lock);
+  for (tries = 0; tries < 2; tries++) {
+    if (!bc_running || bc_online_pages <= CACHE_MIN_PAGES)
+      goto done;
+
+    for (i = bc_page_cnt - 1; i >= 0; i--) {
+      if (bc_pages[i] == NULL)
+        continue;
+      for (j = 0; j < SECTORS_PER_PAGE; j++)
+        if (buffer_cache[i * SECTORS_PER_PAGE + j].pinned > 0)
+          break;
+      if (j == SECTORS_PER_PAGE)
+        break;
+    }
+    if (i < 0)
+      goto done;
+
+    /* Write back dirty entries. bc_lock is released meanwhile, so look
+       for a page again. */
+    int cnt = 0;
+    for (j = 0; j < SECTORS_PER_PAGE; j++) {
+      int index = i * SECTORS_PER_PAGE + j;
+      if (!buffer_cache[index].isempty && buffer_cache[index].isdirty)
+        flush_idx[cnt++] = index;
+    }
+    if (cnt == 0)
+      break;
+    flush_entries(flush_idx, cnt);
+  }
+  if (tries == 2)
+    goto done;
+
+  for (j = 0; j < SECTORS_PER_PAGE; j++) {
+    int index = i * SECTORS_PER_PAGE + j;
+    release_cache_entry(index);
+    list_remove(&buffer_cache[index].free_elem);
+    buffer_cache[index].cache_addr = NULL;
+  }
+  palloc_free_page(bc_pages[i]);
+  bc_pages[i] = NULL;
+  bc_online_pages--;
+  success = true;
+
+ done:
+  lock_release(&bc_lock);
+  lock_release(&flush_lock);
+  return success;
+}
+
+/* Write-behind flusher thread. Wake up every bc_flush_interval ms and
+   write back about FLUSH_BATCH dirty entries, so dirty data reaches disk
+   steadily instead of on eviction or exit. Entries are taken in sector
+   order starting at flush_pos and wrapping around, so successive batches
+   sweep the disk in one direction. Changes of the free map are put into
+   the cache first, so they are written behind like file data. */
+static void
+bc_flusher (void *aux UNUSED)
+{
+  for (;;) {
+    timer_msleep(bc_flush_interval);
+    free_map_flush();
+
+    lock_acquire(&flush_lock);
+    lock_acquire(&bc_lock);
+    if (!bc_running) {
+      lock_release(&bc_lock);
+      lock_release(&flush_lock);
+      return;
+    }
+    int cnt = 0, start, n, i;
+    for (i = 0; i < bc_entry_cnt; i++)
+      if (!buffer_cache[i].isempty && buffer_cache[i].isdirty)
+        flush_idx[cnt++] = i;
+    sort_by_sector(flush_idx, cnt);
+    for (start = 0; start < cnt; start++)
+      if (buffer_cache[flush_idx[start]].sector >= flush_pos)
+        break;
+    if (start == cnt)
+      start = 0;
+
+    /* Take FLUSH_BATCH entries, and the rest of the run reaching past. */
+    for (n = 1; start + n < cnt; n++) {
+      block_sector_t next = buffer_cache[flush_idx[start + n]].sector;
+      if (n >= FLUSH_BATCH
+          && next != buffer_cache[flush_idx[start + n - 1]].sector + 1)
+        break;
+    }
+    if (cnt > 0) {
+      flush_pos = buffer_cache[flush_idx[start + n - 1]].sector + 1;
+      flush_entries(flush_idx + start, n);
+    }
+    lock_release(&bc_lock);
+    lock_release(&flush_lock);
   }
 }
 
+/* Read-ahead thread. Take sector from read-ahead queue, and load it into
+   buffer cache if it is not cached yet. Runs while the reader that queued
+   the sector is still copying its current sector. Entry is pinned and its
+   io_lock held while it is loaded, as in pin_cache_entry(). */
+static void
+bc_read_aheader (void *aux UNUSED)
+{
+  for (;;) {
+    lock_acquire(&ra_lock);
+    while (ra_cnt == 0)
+      cond_wait(&ra_cond, &ra_lock);
+    block_sector_t sector = ra_queue[ra_head];
+    ra_head = (ra_head + 1) % READ_AHEAD_QUEUE;
+    ra_cnt--;
+    lock_release(&ra_lock);
+
+    pin_enter();
+    lock_acquire(&bc_lock);
+    if (!bc_running) {
+      lock_release(&bc_lock);
+      pin_leave();
+      return;
+    }
+    int index;
+    while ((index = bc_lookup(sector)) == -1) {
+      index = alloc_cache_entry(sector);
+      if (index == -1)
+        continue;
+      struct cache_entry *ce = &buffer_cache[index];
+      ce->pinned++;
+      lock_acquire(&ce->io_lock);
+      lock_release(&bc_lock);
+      block_read(fs_device, sector, ce->cache_addr);
+      lock_release(&ce->io_lock);
+      lock_acquire(&bc_lock);
+      bc_stat.read_ahead_cnt++;
+      if (--ce->pinned == 0)
+        cond_broadcast(&bc_unpinned, &bc_lock);
+      break;
+    }
+    lock_release(&bc_lock);
+    pin_leave();
+  }
+}
+
+/* Hash function of cache index. Hash by disk sector. */
+static unsigned
+bc_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct cache_entry *ce = hash_entry(e, struct cache_entry, hash_elem);
+  return hash_int((int) ce->sector);
+}
+
+/* Compare two cache entries by disk sector. */
+static bool
+bc_less_func (const struct hash_elem *a, const struct hash_elem *b,
+              void *aux UNUSED)
+{
+  struct cache_entry *ca = hash_entry(a, struct cache_entry, hash_elem);
+  struct cache_entry *cb = hash_entry(b, struct cache_entry, hash_elem);
+  return ca->sector < cb->sector;
+}
+
 /* Get next empty buffer cache. Return index of empty buffer cache. If cache
    full. return -1. */
 static int
 get_cache_entry(void)
 {
-  int i;
-  for (i=0; i < CACHE_SECTOR_NUMBER; i++) {
-    if (buffer_cache[i].isempty == true)
-      return i;
+  if (list_empty(&free_entries))
+    return -1;
+  struct list_elem *e = list_pop_front(&free_entries);
+  return list_entry(e, struct cache_entry, free_elem) - buffer_cache;
+}
+
+/* Make cache entry 'index' empty. Remove it from cache index and give it
+   back to free entry list. Entry must be clean and not pinned. */
+static void
+release_cache_entry(int index)
+{
+  ASSERT (!buffer_cache[index].isdirty);
+  ASSERT (buffer_cache[index].pinned == 0);
+  if (buffer_cache[index].isempty)
+    return;
+  bc_policy->remove(&buffer_cache[index]);
+  hash_delete(&cache_index, &buffer_cache[index].hash_elem);
+  buffer_cache[index].isempty = true;
+  list_push_back(&free_entries, &buffer_cache[index].free_elem);
+}
+
+/* Get cache entry for 'sector' that is not cached yet. Use empty entry if
+   exists, otherwise grow cache if it was shrunk and memory is available
+   again, otherwise evict victim. Returned entry is registered to cache
+   index, but its contents are not loaded. Must be called with bc_lock
+   held. If a dirty victim has to be written back, or every entry is
+   pinned, bc_lock is released for a while and -1 is returned; caller must
+   look up 'sector' again, since it may be cached meanwhile. */
+static int
+alloc_cache_entry(block_sector_t sector)
+{
+  int index = get_cache_entry();
+  if (index == -1 && bc_online_pages < bc_page_cnt
+      && timer_elapsed(bc_grow_fail) >= TIMER_FREQ && bc_grow())
+    index = get_cache_entry();
+  if (index == -1) {
+    index = bc_select_victim();
+    if (index == -1) {
+      cond_wait(&bc_unpinned, &bc_lock);
+      return -1;
+    }
+    if (buffer_cache[index].isdirty) {
+      lock_release(&bc_lock);
+      lock_acquire(&flush_lock);
+      lock_acquire(&bc_lock);
+      if (!buffer_cache[index].isempty && buffer_cache[index].isdirty)
+        flush_run(index);
+      lock_release(&flush_lock);
+      return -1;
+    }
+    bc_stat.evict_cnt++;
+    if (buffer_cache[index].hit_cnt == 0)
+      bc_stat.unused_evict_cnt++;
+    release_cache_entry(index);
+    list_remove(&buffer_cache[index].free_elem);
   }
-  return -1;
+  buffer_cache[index].sector = sector;
+  buffer_cache[index].isempty = false;
+  buffer_cache[index].hit_cnt = 0;
+  hash_insert(&cache_index, &buffer_cache[index].hash_elem);
+  bc_policy->insert(&buffer_cache[index]);
+  return index;
 }
 
 /* Look up buffer cache and find cache_entry that has sector. If no matching
@@ -60,59 +511,551 @@ get_cache_entry(void)
 int
 bc_lookup(block_sector_t sector)
 {
-  int i;
-  for(i=0; i < CACHE_SECTOR_NUMBER; i++) {
-    if (!buffer_cache[i].isempty && (buffer_cache[i].sector == sector)) {
-      return i;
-    }
-  }
-  return -1;
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find(&cache_index, &key.hash_elem);
+  if (e == NULL)
+    return -1;
+  return hash_entry(e, struct cache_entry, hash_elem) - buffer_cache;
 }
 
-/* Select victim entry to evict when cache is full. Return index of victim
-   cache entry. Based on Clock algorithm. If buffer cache entry's clock bit
-   is true, change clock bit to false and pass. If clock bit is false, check
-   if that entry is dirty, flush it to disk and return. */
+/* Select victim entry to evict when cache is full, using replacement
+   policy chosen at boot. Every policy prefers clean entries, so a miss
+   rarely waits for a write. Victim is dirty only if no clean entry is
+   unpinned; caller writes it back with its dirty neighbours (see
+   flush_run()). Return index of victim cache
+   entry, or -1 if every entry is pinned. Pinned entries are never chosen.
+   Must be called with bc_lock held. */
 int
 bc_select_victim (void)
 {
+  struct cache_entry *victim = bc_policy->victim();
+  return victim != NULL ? victim - buffer_cache : -1;
+}
+
+/* CLOCK policy. Clock hand persists across calls, so every entry gets the
+   same chance. If entry's clock bit is true, change it to false and pass.
+   If clock bit is false, it is a candidate. Clean candidate is returned at
+   once; dirty one is returned only if no clean candidate is found within a
+   revolution, so that the caller rarely waits for a write. */
+static int clock_hand;
+
+static void
+clock_init (void)
+{
+  clock_hand = 0;
+}
+
+static void
+clock_insert (struct cache_entry *ce)
+{
+  ce->clock = false;
+}
+
+static void
+clock_access (struct cache_entry *ce)
+{
+  ce->clock = true;
+}
+
+static void
+clock_remove (struct cache_entry *ce)
+{
+  ce->clock = false;
+}
+
+static struct cache_entry *
+clock_victim (void)
+{
+  struct cache_entry *dirty = NULL;
   int i;
-  for (i=0; i < CACHE_SECTOR_NUMBER; i++) {
-    if (!buffer_cache[i].clock) {
-      if (buffer_cache[i].isdirty == true) {
-        bc_flush_entry(i);
-      }
-      return i;
-    }
-    else {
-      buffer_cache[i].clock = false;
+  for (i = 0; i < 2 * bc_entry_cnt; i++) {
+    struct cache_entry *ce = &buffer_cache[clock_hand];
+    if (dirty != NULL && i >= bc_entry_cnt)
+      break;
+    clock_hand = (clock_hand + 1) % bc_entry_cnt;
+    if (ce->isempty || ce->pinned > 0)
+      continue;
+    if (ce->clock)
+      ce->clock = false;
+    else if (!ce->isdirty)
+      return ce;
+    else if (dirty == NULL)
+      dirty = ce;
+  }
+  return dirty;
+}
+
+/* LRU policy. Entries are kept in access order, most recently used first,
+   and victim is the least recently used unpinned clean entry, or the
+   least recently used unpinned dirty one if there is no clean one. */
+static struct list lru_entries;
+
+static void
+lru_init (void)
+{
+  list_init(&lru_entries);
+}
+
+static void
+lru_insert (struct cache_entry *ce)
+{
+  list_push_front(&lru_entries, &ce->policy_elem);
+}
+
+static void
+lru_access (struct cache_entry *ce)
+{
+  list_remove(&ce->policy_elem);
+  list_push_front(&lru_entries, &ce->policy_elem);
+}
+
+static void
+lru_remove (struct cache_entry *ce)
+{
+  list_remove(&ce->policy_elem);
+}
+
+static struct cache_entry *
+lru_victim (void)
+{
+  struct cache_entry *dirty = NULL;
+  struct list_elem *e;
+  for (e = list_rbegin(&lru_entries); e != list_rend(&lru_entries);
+       e = list_prev(e)) {
+    struct cache_entry *ce = list_entry(e, struct cache_entry, policy_elem);
+    if (ce->pinned > 0)
+      continue;
+    if (!ce->isdirty)
+      return ce;
+    if (dirty == NULL)
+      dirty = ce;
+  }
+  return dirty;
+}
+
+/* 2Q policy (scan resistant). Sector referenced for the first time goes to
+   FIFO queue A1in. When it is evicted from A1in, its sector number is
+   remembered in ghost queue A1out. Only sector referenced again while in
+   A1out is placed in LRU queue Am. So a long sequential scan passes through
+   A1in and does not push hot sectors out of Am. */
+enum twoq_queue
+  {
+    TWOQ_A1IN,
+    TWOQ_AM
+  };
+
+/* Sector remembered in A1out. */
+struct twoq_ghost
+  {
+    block_sector_t sector;
+    struct hash_elem hash_elem;                 /* Element in twoq_ghosts. */
+    struct list_elem list_elem;                 /* Element in A1out. */
+  };
+
+static struct list twoq_a1in, twoq_am, twoq_a1out;
+static int twoq_a1in_cnt;
+static struct twoq_ghost *twoq_ghost_pool;
+static struct list twoq_free_ghosts;
+static struct hash twoq_ghosts;
+
+static unsigned
+twoq_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct twoq_ghost *g = hash_entry(e, struct twoq_ghost, hash_elem);
+  return hash_int((int) g->sector);
+}
+
+static bool
+twoq_less_func (const struct hash_elem *a, const struct hash_elem *b,
+                void *aux UNUSED)
+{
+  struct twoq_ghost *ga = hash_entry(a, struct twoq_ghost, hash_elem);
+  struct twoq_ghost *gb = hash_entry(b, struct twoq_ghost, hash_elem);
+  return ga->sector < gb->sector;
+}
+
+static void
+twoq_init (void)
+{
+  list_init(&twoq_a1in);
+  list_init(&twoq_am);
+  list_init(&twoq_a1out);
+  list_init(&twoq_free_ghosts);
+  twoq_a1in_cnt = 0;
+  twoq_ghost_pool = malloc(TWOQ_KOUT * sizeof *twoq_ghost_pool);
+  if (twoq_ghost_pool == NULL)
+    PANIC ("buffer cache allocation failed");
+  int i;
+  for (i = 0; i < TWOQ_KOUT; i++)
+    list_push_back(&twoq_free_ghosts, &twoq_ghost_pool[i].list_elem);
+  if (!hash_init(&twoq_ghosts, twoq_hash_func, twoq_less_func, NULL))
+    exit(-1);
+}
+
+static void
+twoq_insert (struct cache_entry *ce)
+{
+  struct twoq_ghost key;
+  struct hash_elem *e;
+
+  key.sector = ce->sector;
+  e = hash_delete(&twoq_ghosts, &key.hash_elem);
+  if (e != NULL) {
+    /* Referenced again soon after eviction from A1in: it is hot. */
+    struct twoq_ghost *g = hash_entry(e, struct twoq_ghost, hash_elem);
+    list_remove(&g->list_elem);
+    list_push_back(&twoq_free_ghosts, &g->list_elem);
+    ce->queue = TWOQ_AM;
+    list_push_front(&twoq_am, &ce->policy_elem);
+  }
+  else {
+    ce->queue = TWOQ_A1IN;
+    list_push_front(&twoq_a1in, &ce->policy_elem);
+    twoq_a1in_cnt++;
+  }
+}
+
+static void
+twoq_access (struct cache_entry *ce)
+{
+  if (ce->queue == TWOQ_AM) {
+    list_remove(&ce->policy_elem);
+    list_push_front(&twoq_am, &ce->policy_elem);
+  }
+}
+
+static void
+twoq_remove (struct cache_entry *ce)
+{
+  list_remove(&ce->policy_elem);
+  if (ce->queue == TWOQ_AM)
+    return;
+  twoq_a1in_cnt--;
+
+  /* Remember sector in A1out, recycling the oldest ghost if full. */
+  struct twoq_ghost *g;
+  if (!list_empty(&twoq_free_ghosts))
+    g = list_entry(list_pop_front(&twoq_free_ghosts), struct twoq_ghost,
+                   list_elem);
+  else {
+    g = list_entry(list_pop_back(&twoq_a1out), struct twoq_ghost, list_elem);
+    hash_delete(&twoq_ghosts, &g->hash_elem);
+  }
+  g->sector = ce->sector;
+  hash_insert(&twoq_ghosts, &g->hash_elem);
+  list_push_front(&twoq_a1out, &g->list_elem);
+}
+
+/* Return the oldest unpinned entry of queue LIST that is clean, or may
+   be dirty if DIRTY_OK, or NULL. */
+static struct cache_entry *
+twoq_oldest (struct list *list, bool dirty_ok)
+{
+  struct list_elem *e;
+  for (e = list_rbegin(list); e != list_rend(list); e = list_prev(e)) {
+    struct cache_entry *ce = list_entry(e, struct cache_entry, policy_elem);
+    if (ce->pinned == 0 && (dirty_ok || !ce->isdirty))
+      return ce;
+  }
+  return NULL;
+}
+
+/* Return the oldest clean unpinned entry of queue LIST, or its oldest
+   dirty unpinned entry if it has no clean one, or NULL if every entry
+   is pinned. */
+static struct cache_entry *
+twoq_queue_victim (struct list *list)
+{
+  struct cache_entry *victim = twoq_oldest(list, false);
+  return victim != NULL ? victim : twoq_oldest(list, true);
+}
+
+/* Evict from A1in while it is over its share, and from Am otherwise.
+   Clean entries are preferred only within that queue: a dirty A1in,
+   as during a long sequential write, must not push out hot entries of
+   Am. The other queue is used only if every entry of this one is
+   pinned. */
+static struct cache_entry *
+twoq_victim (void)
+{
+  struct list *first = &twoq_am, *second = &twoq_a1in;
+  struct cache_entry *victim;
+
+  if (twoq_a1in_cnt > TWOQ_KIN || list_empty(&twoq_am)) {
+    first = &twoq_a1in;
+    second = &twoq_am;
+  }
+  victim = twoq_queue_victim(first);
+  return victim != NULL ? victim : twoq_queue_victim(second);
+}
+
+/* Replacement policies which can be chosen by "-bcpolicy". */
+static const struct bc_policy bc_policies[] =
+  {
+    {"clock", clock_init, clock_insert, clock_access, clock_remove,
+     clock_victim},
+    {"lru", lru_init, lru_insert, lru_access, lru_remove, lru_victim},
+    {"2q", twoq_init, twoq_insert, twoq_access, twoq_remove, twoq_victim},
+  };
+
+/* Choose buffer cache replacement policy by NAME. Must be called before
+   bc_init(). Return false if there is no such policy. */
+bool
+bc_set_policy (const char *name)
+{
+  size_t i;
+  for (i = 0; i < sizeof bc_policies / sizeof *bc_policies; i++) {
+    if (!strcmp(name, bc_policies[i].name)) {
+      bc_policy = &bc_policies[i];
+      return true;
     }
   }
-  if (buffer_cache[0].isdirty)
-    bc_flush_entry(0);
-  return 0;
+  return false;
 }
 
-/* Flush buffer cache index 'index' to disk. Use block_write function. */
+/* Flush buffer cache index 'index' to disk. Entry stays in the cache.
+   Must be called with flush_lock and bc_lock held. */
 void
 bc_flush_entry(int index)
+{
+  flush_entries(&index, 1);
+}
+
+/* Compare two cache entry indexes by sector of the entries. */
+static int
+sector_compare (const void *a_, const void *b_, void *aux UNUSED)
+{
+  block_sector_t a = buffer_cache[*(const int *) a_].sector;
+  block_sector_t b = buffer_cache[*(const int *) b_].sector;
+  return a < b ? -1 : a > b;
+}
+
+/* Sort CNT cache entry indexes in IDX by sector. */
+static void
+sort_by_sector(int *idx, int cnt)
+{
+  sort(idx, cnt, sizeof *idx, sector_compare, NULL);
+}
+
+/* Write back CNT dirty entries whose indexes are in IDX. Entries are
+   written in sector order, and each run of consecutive sectors goes to disk
+   as one multi-sector write. IDX is sorted in place. Must be called with
+   flush_lock and bc_lock held. bc_lock is released during the writes;
+   entries are pinned meanwhile and marked clean before, so that data
+   written to them during the writes makes them dirty again. */
+static void
+flush_entries(int *idx, int cnt)
+{
+  int i, j;
+  if (cnt == 0)
+    return;
+  sort_by_sector(idx, cnt);
+  for (i = 0; i < cnt; i++) {
+    buffer_cache[idx[i]].pinned++;
+    buffer_cache[idx[i]].isdirty = false;
+  }
+  lock_release(&bc_lock);
+
+  for (i = 0; i < cnt; i = j) {
+    block_sector_t first = buffer_cache[idx[i]].sector;
+    for (j = i; j < cnt && buffer_cache[idx[j]].sector == first + (j - i); j++)
+      flush_bufs[j - i] = buffer_cache[idx[j]].cache_addr;
+    block_write_multiple(fs_device, first, flush_bufs, j - i);
+    lock_acquire(&bc_lock);
+    bc_stat.write_back_cnt += j - i;
+    bc_stat.write_io_cnt++;
+    lock_release(&bc_lock);
+  }
+
+  lock_acquire(&bc_lock);
+  for (i = 0; i < cnt; i++)
+    buffer_cache[idx[i]].pinned--;
+  cond_broadcast(&bc_unpinned, &bc_lock);
+}
+
+/* Write back dirty entry 'index' together with the dirty cached sectors
+   right before and after it, up to FLUSH_RUN_MAX sectors in all, as one
+   write. Sequentially written data is then evicted in large writes rather
+   than sector by sector. Must be called with flush_lock and bc_lock held;
+   bc_lock is released during the write. */
+static void
+flush_run(int index)
 {
   block_sector_t sector = buffer_cache[index].sector;
-  block_write(fs_device, sector, buffer_cache[index].cache_addr);
-  buffer_cache[index].isdirty = false;
-  buffer_cache[index].isempty = true;
+  block_sector_t lo = sector, hi = sector;
+  int cnt = 1, i;
+
+  while (cnt < FLUSH_RUN_MAX && lo > 0) {
+    i = bc_lookup(lo - 1);
+    if (i == -1 || !buffer_cache[i].isdirty)
+      break;
+    lo--;
+    cnt++;
+  }
+  while (cnt < FLUSH_RUN_MAX) {
+    i = bc_lookup(hi + 1);
+    if (i == -1 || !buffer_cache[i].isdirty)
+      break;
+    hi++;
+    cnt++;
+  }
+
+  for (cnt = 0; lo + cnt <= hi; cnt++)
+    flush_idx[cnt] = bc_lookup(lo + cnt);
+  flush_entries(flush_idx, cnt);
 }
 
-/* Flush all dirty sectors in buffer cache to disk. */
+/* Flush all dirty sectors in buffer cache to disk, in sector order. */
 void
 bc_flush_all(void)
 {
-  int i;
-  for(i=0; i < CACHE_SECTOR_NUMBER; i++){
-    if (buffer_cache[i].isdirty == true && buffer_cache[i].isempty == false) {
-      bc_flush_entry(i);
-    }
+  int cnt = 0, i;
+  lock_acquire(&flush_lock);
+  lock_acquire(&bc_lock);
+  for(i=0; i < bc_entry_cnt; i++){
+    if (buffer_cache[i].isdirty == true && buffer_cache[i].isempty == false)
+      flush_idx[cnt++] = i;
+  }
+  flush_entries(flush_idx, cnt);
+  lock_release(&bc_lock);
+  lock_release(&flush_lock);
+}
+
+/* Flush cached dirty sectors among CNT sectors from 'sector' to disk,
+   coalescing consecutive ones. */
+void
+bc_flush_range(block_sector_t sector, size_t cnt)
+{
+  size_t i;
+  int n = 0;
+  lock_acquire(&flush_lock);
+  lock_acquire(&bc_lock);
+  for (i = 0; i < cnt; i++) {
+    int index = bc_lookup(sector + i);
+    if (index != -1 && buffer_cache[index].isdirty)
+      flush_idx[n++] = index;
+  }
+  flush_entries(flush_idx, n);
+  lock_release(&bc_lock);
+  lock_release(&flush_lock);
+}
+
+/* Flush 'sector' to disk if it is cached and dirty. */
+void
+bc_flush_sector(block_sector_t sector)
+{
+  lock_acquire(&flush_lock);
+  lock_acquire(&bc_lock);
+  int index = bc_lookup(sector);
+  if (index != -1 && buffer_cache[index].isdirty)
+    bc_flush_entry(index);
+  lock_release(&bc_lock);
+  lock_release(&flush_lock);
+}
+
+/* Count a pin taken by the current thread, first waiting for a slot in
+   pin_slots if it holds no pins yet. Must be called without bc_lock. */
+static void
+pin_enter (void)
+{
+  if (thread_current()->bc_pins++ == 0)
+    sema_down(&pin_slots);
+}
+
+/* Count a pin released by the current thread, giving back its slot in
+   pin_slots with its last pin. */
+static void
+pin_leave (void)
+{
+  if (--thread_current()->bc_pins == 0)
+    sema_up(&pin_slots);
+}
+
+/* Find cache entry of 'sector' and pin it, so that it is not evicted and
+   its data can be accessed without bc_lock. If no such sector exist in
+   buffer cache, allocate new buffer cache and, if LOAD is true, read sector
+   from disk to buffer cache, otherwise clear it. WRITE tells whether the
+   caller is going to write, only for statistics. Return index of entry.
+   Sector is read without bc_lock, holding entry's io_lock; a thread that
+   hits the entry meanwhile waits on io_lock until the data is there. */
+static int
+pin_cache_entry(block_sector_t sector, bool load, bool write)
+{
+  struct cache_entry *ce;
+  int index;
+
+  pin_enter();
+  lock_acquire(&bc_lock);
+  while ((index = bc_lookup(sector)) == -1) {
+    index = alloc_cache_entry(sector);
+    if (index == -1)
+      continue;
+    ce = &buffer_cache[index];
+    ce->pinned++;
+    bc_stat.miss_cnt++;
+    if (load && write)
+      bc_stat.rbw_cnt++;
+    lock_acquire(&ce->io_lock);
+    lock_release(&bc_lock);
+    if (load)
+      block_read(fs_device, sector, ce->cache_addr);
+    else
+      memset(ce->cache_addr, 0, BLOCK_SECTOR_SIZE);
+    lock_release(&ce->io_lock);
+    return index;
   }
+  ce = &buffer_cache[index];
+  ce->pinned++;
+  ce->hit_cnt++;
+  bc_stat.hit_cnt++;
+  lock_release(&bc_lock);
+
+  /* Wait until entry is loaded, if it is being loaded. */
+  lock_acquire(&ce->io_lock);
+  lock_release(&ce->io_lock);
+  return index;
+}
+
+/* Unpin cache entry 'index' pinned by pin_cache_entry(). If DIRTY is true,
+   its data was modified. */
+static void
+unpin_cache_entry(int index, bool dirty)
+{
+  lock_acquire(&bc_lock);
+  ASSERT (buffer_cache[index].pinned > 0);
+  if (dirty)
+    buffer_cache[index].isdirty = true;
+  bc_policy->access(&buffer_cache[index]);
+  if (--buffer_cache[index].pinned == 0)
+    cond_broadcast(&bc_unpinned, &bc_lock);
+  lock_release(&bc_lock);
+  pin_leave();
+}
+
+/* Pin 'sector' in buffer cache and return pointer to its cached data
+   (BLOCK_SECTOR_SIZE bytes), so that caller can inspect or modify it in
+   place without copy. Sector stays in the cache until bc_unpin() is
+   called. Caller must not block on anything that needs the cache to evict
+   many entries while holding pins, nor hold more than PIN_DEPTH_MAX. */
+void *
+bc_pin(block_sector_t sector)
+{
+  return buffer_cache[pin_cache_entry(sector, true, false)].cache_addr;
+}
+
+/* Unpin 'sector' pinned by bc_pin(). If DIRTY is true, caller modified
+   its data, and it will be written back to disk. */
+void
+bc_unpin(block_sector_t sector, bool dirty)
+{
+  lock_acquire(&bc_lock);
+  int index = bc_lookup(sector);
+  lock_release(&bc_lock);
+  ASSERT (index != -1);
+  unpin_cache_entry(index, dirty);
 }
 
 /* Read sector to buffer in buffer cache. If no such sector exist in buffer
@@ -121,41 +1064,61 @@ bc_flush_all(void)
 void
 bc_read(block_sector_t sector, void *buffer, int chunk_size, int sector_ofs)
 {
-  int index = bc_lookup(sector);
-  if (index == -1) {
-    index = get_cache_entry();
-    if (index == -1) {
-      index = bc_select_victim();
-    }
-    block_read(fs_device, sector, buffer_cache[index].cache_addr);
-    buffer_cache[index].sector = sector;
-    buffer_cache[index].isempty = false;
-  }
+  int index = pin_cache_entry(sector, true, false);
   uint8_t *c_addr = buffer_cache[index].cache_addr;
   memcpy(buffer, c_addr + sector_ofs, chunk_size);
-  buffer_cache[index].clock = true;
+  unpin_cache_entry(index, false);
+}
+
+/* Ask read-ahead thread to load 'sector' into buffer cache in background.
+   Does not wait. Request is dropped if read-ahead queue is full. */
+void
+bc_read_ahead(block_sector_t sector)
+{
+  lock_acquire(&ra_lock);
+  if (ra_cnt < READ_AHEAD_QUEUE) {
+    ra_queue[(ra_head + ra_cnt) % READ_AHEAD_QUEUE] = sector;
+    ra_cnt++;
+    cond_signal(&ra_cond, &ra_lock);
+  }
+  lock_release(&ra_lock);
 }
 
 /* Write buffer to sector in buffer cache. If no such sector exist in buffer
    cache, allocate new buffer cache and read sector from disk to buffer cache.
-   Then, write buffer to buffer cache who have 'sector', and mark dirty bit to
-   true. */
+   If whole sector is overwritten, old contents are not needed, so sector is
+   not read and the entry is just cleared. Then, write buffer to buffer cache
+   who have 'sector', and mark dirty bit to true. */
 void
 bc_write(block_sector_t sector, const void *buffer, int chunk_size,
                                                     int sector_ofs)
 {
-  int index = bc_lookup(sector);
-  if (index == -1) {
-    index = get_cache_entry();
-    if (index == -1) {
-      index = bc_select_victim();
-    }
-    block_read(fs_device, sector, buffer_cache[index].cache_addr);
-    buffer_cache[index].sector = sector;
-    buffer_cache[index].isempty = false;
-  }
+  bool full = sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE;
+  int index = pin_cache_entry(sector, !full, true);
   uint8_t *c_addr = buffer_cache[index].cache_addr;
   memcpy(c_addr + sector_ofs, buffer, chunk_size);
-  buffer_cache[index].isdirty = true;
-  buffer_cache[index].clock = true;
+  unpin_cache_entry(index, true);
+}
+
+/* Copy buffer cache statistics into ST. */
+void
+bc_get_stat(struct cache_stat *st)
+{
+  lock_acquire(&bc_lock);
+  *st = bc_stat;
+  st->entry_cnt = bc_online_pages * SECTORS_PER_PAGE;
+  lock_release(&bc_lock);
+}
+
+/* Prints buffer cache statistics. Called at shutdown, after bc_exit(). */
+void
+bc_print_stats(void)
+{
+  printf ("Buffer cache: %llu hits, %llu misses, %llu evictions "
+          "(%llu unused), %llu write-backs in %llu writes\n",
+          bc_stat.hit_cnt, bc_stat.miss_cnt, bc_stat.evict_cnt,
+          bc_stat.unused_evict_cnt, bc_stat.write_back_cnt,
+          bc_stat.write_io_cnt);
+  printf ("Buffer cache: %llu reads before write, %llu read-aheads\n",
+          bc_stat.rbw_cnt, bc_stat.read_ahead_cnt);
 }
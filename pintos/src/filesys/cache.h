@@ -1,9 +1,13 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
 
+#include <cache-stat.h>
 #include "devices/block.h"
 #include "filesys/inode.h"
+#include "lib/kernel/hash.h"
+#include "lib/kernel/list.h"
 #include "lib/stdbool.h"
+#include "threads/synch.h"
 
 /* Cache entry structure. */
 struct cache_entry
@@ -11,20 +15,47 @@ struct cache_entry
   bool isdirty;                             /* Dirty flag */
   bool isempty;                             /* Empty flag */
   bool clock;                               /* Clock bit (for eviction) */
+  int pinned;                               /* # of users copying data */
+  int queue;                                /* Queue of policy (for 2Q) */
+  unsigned hit_cnt;                         /* # of hits since loaded */
+  struct lock io_lock;                      /* Held while loading data */
 
   void *cache_addr;                         /* Memory space for cache entry */
   block_sector_t sector;                    /* Disk's sector */
+
+  struct hash_elem hash_elem;               /* Element in cache index */
+  struct list_elem free_elem;               /* Element in free entry list */
+  struct list_elem policy_elem;             /* Element in policy's list */
 };
 
+/* Interval of write-behind flusher in milliseconds. 0 disables it.
+   Controlled by kernel command-line option "-bcflush=MS". */
+extern unsigned bc_flush_interval;
+
+/* Number of sectors in buffer cache. Rounded up to whole pages.
+   Controlled by kernel command-line option "-bcsize=N". */
+extern size_t bc_size;
+
+bool bc_set_policy (const char *);
 void bc_init (void);
 void bc_exit (void);
+bool bc_shrink (void);
 
 int bc_lookup (block_sector_t);
 int bc_select_victim (void);
 void bc_flush_entry (int);
 void bc_flush_all (void);
+void bc_flush_sector (block_sector_t);
+void bc_flush_range (block_sector_t, size_t);
 
 void bc_read (block_sector_t, void *, int, int);
+void bc_read_ahead (block_sector_t);
 void bc_write (block_sector_t, const void *, int, int);
 
+void *bc_pin (block_sector_t);
+void bc_unpin (block_sector_t, bool);
+
+void bc_get_stat (struct cache_stat *);
+void bc_print_stats (void);
+
 #endif /* filesys/cache.h */
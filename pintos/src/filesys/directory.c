@@ -1,4 +1,7 @@
 #include "filesys/directory.h"
+#include <bitmap.h>
+#include <dirent.h>
+#include <hash.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
@@ -6,6 +9,7 @@
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 /* A directory. */
 struct dir 
@@ -22,6 +26,65 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* In-memory name index of a directory, so that lookup and insertion
+   do not scan all entries. Indexes are kept in index_cache by
+   directory sector, so they outlive the directory's inode and are
+   built only on first use and after eviction. An index holds every
+   name in its directory, so a name it lacks does not exist.
+   Names and slots are modified only with the directory locked for
+   writing and the index's lock held for writing. Path walks (see
+   dir_index_step()) read an index holding only its lock, without
+   opening the directory. */
+struct dir_index
+  {
+    block_sector_t sector;              /* Sector of directory inode. */
+    struct rwlock lock;                 /* Protects names and stale. */
+    struct hash names;                  /* index_entry's by name. */
+    struct bitmap *used;                /* Entry slots in use. */
+    bool stale;                         /* Directory removed? */
+    int ref_cnt;                        /* Number of users. */
+    bool cached;                        /* In index_cache? */
+    struct hash_elem elem;              /* Element in index_cache. */
+    struct list_elem lru_elem;          /* Element in index_lru. */
+  };
+
+/* Entry of dir_index. */
+struct index_entry
+  {
+    struct hash_elem elem;              /* Element in names. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    off_t ofs;                          /* Offset of directory entry. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+/* Number of directory indexes kept in index_cache. Indexes in use are
+   not evicted, so there may be more for a while. */
+#define INDEX_CACHE_CNT 32
+
+static struct hash index_cache;         /* Indexes by directory sector. */
+static struct list index_lru;           /* Cached indexes, recent first. */
+static size_t index_cache_cnt;          /* Number of cached indexes. */
+
+/* Protects all of the above, and ref_cnt and cached of each index.
+   Only looking up and inserting indexes is serialized by it; each
+   index is built under its own directory's lock. May be acquired
+   while holding an index's lock, but not the other way around. */
+static struct lock index_cache_lock;
+
+static unsigned index_cache_hash (const struct hash_elem *, void *);
+static bool index_cache_less (const struct hash_elem *,
+                              const struct hash_elem *, void *);
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  if (!hash_init (&index_cache, index_cache_hash, index_cache_less, NULL))
+    PANIC ("directory index cache creation failed");
+  list_init (&index_lru);
+  lock_init (&index_cache_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -86,24 +149,397 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Check if directroy 'name' in 'dir' is empty or not.
+/* Hash function of dir_index. Hash by name. */
+static unsigned
+index_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct index_entry, elem)->name);
+}
+
+/* Compare two index entries by name. */
+static bool
+index_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct index_entry, elem)->name,
+                 hash_entry (b, struct index_entry, elem)->name) < 0;
+}
+
+/* Frees index entry E. */
+static void
+index_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct index_entry, elem));
+}
+
+/* Destroys directory index INDEX. */
+static void
+index_destroy (struct dir_index *index)
+{
+  if (index != NULL)
+    {
+      hash_destroy (&index->names, index_free);
+      bitmap_destroy (index->used);
+      free (index);
+    }
+}
+
+/* Hash function of index_cache. Hash by directory sector. */
+static unsigned
+index_cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int ((int) hash_entry (e, struct dir_index, elem)->sector);
+}
+
+/* Compare two cached indexes by directory sector. */
+static bool
+index_cache_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  return (hash_entry (a, struct dir_index, elem)->sector
+          < hash_entry (b, struct dir_index, elem)->sector);
+}
+
+/* Returns cached index of directory SECTOR with a reference taken, or
+   a null pointer. Must be called with index_cache_lock held. */
+static struct dir_index *
+index_cache_find (block_sector_t sector)
+{
+  struct dir_index key, *index;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&index_cache, &key.elem);
+  if (e == NULL)
+    return NULL;
+  index = hash_entry (e, struct dir_index, elem);
+  index->ref_cnt++;
+  list_remove (&index->lru_elem);
+  list_push_front (&index_lru, &index->lru_elem);
+  return index;
+}
+
+/* Removes INDEX from index_cache. It is destroyed when its last user
+   releases it. Must be called with index_cache_lock held. */
+static void
+index_uncache (struct dir_index *index)
+{
+  if (index->cached)
+    {
+      hash_delete (&index_cache, &index->elem);
+      list_remove (&index->lru_elem);
+      index->cached = false;
+      index_cache_cnt--;
+    }
+}
+
+/* Releases a reference to INDEX taken by get_index() or
+   index_cache_find(). */
+static void
+index_release (struct dir_index *index)
+{
+  bool destroy;
+
+  if (index == NULL)
+    return;
+  lock_acquire (&index_cache_lock);
+  destroy = --index->ref_cnt == 0 && !index->cached;
+  lock_release (&index_cache_lock);
+  if (destroy)
+    index_destroy (index);
+}
+
+/* Removes INDEX from index_cache and marks it stale, so that path
+   walks holding it fail instead of following a directory that may
+   be gone. Must not be called with INDEX's lock held. */
+static void
+index_drop (struct dir_index *index)
+{
+  lock_acquire (&index_cache_lock);
+  index_uncache (index);
+  lock_release (&index_cache_lock);
+
+  rwlock_acquire_write (&index->lock);
+  index->stale = true;
+  rwlock_release (&index->lock);
+}
+
+/* Drops cached index of directory SECTOR, if any. Called when the
+   directory is removed, so that the index of a later directory in
+   the same sector is built from its own entries. */
+static void
+index_purge (block_sector_t sector)
+{
+  struct dir_index *index;
+
+  lock_acquire (&index_cache_lock);
+  index = index_cache_find (sector);
+  lock_release (&index_cache_lock);
+  if (index != NULL)
+    {
+      index_drop (index);
+      index_release (index);
+    }
+}
+
+/* Sets entry slot SLOT of INDEX in use, growing the slot bitmap if
+   needed. Returns false if memory is short. */
+static bool
+index_use_slot (struct dir_index *index, size_t slot)
+{
+  size_t i, cnt = bitmap_size (index->used);
+
+  if (slot >= cnt)
+    {
+      struct bitmap *used = bitmap_create (slot < cnt * 2 ? cnt * 2
+                                                          : slot + 1);
+      if (used == NULL)
+        return false;
+      for (i = 0; i < cnt; i++)
+        if (bitmap_test (index->used, i))
+          bitmap_mark (used, i);
+      bitmap_destroy (index->used);
+      index->used = used;
+    }
+  bitmap_mark (index->used, slot);
+  return true;
+}
+
+/* Adds directory entry E at offset OFS to INDEX. Returns false if
+   memory is short. */
+static bool
+index_insert (struct dir_index *index, const struct dir_entry *e, off_t ofs)
+{
+  struct index_entry *ie = malloc (sizeof *ie);
+
+  if (ie == NULL || !index_use_slot (index, ofs / sizeof *e))
+    {
+      free (ie);
+      return false;
+    }
+  ie->inode_sector = e->inode_sector;
+  ie->ofs = ofs;
+  strlcpy (ie->name, e->name, sizeof ie->name);
+  hash_insert (&index->names, &ie->elem);
+  return true;
+}
+
+/* Returns index entry of NAME in INDEX, or a null pointer. */
+static struct index_entry *
+index_find (struct dir_index *index, const char *name)
+{
+  struct index_entry key;
+  struct hash_elem *e;
+
+  if (strnlen (name, NAME_MAX + 1) > NAME_MAX)
+    return NULL;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&index->names, &key.elem);
+  return e != NULL ? hash_entry (e, struct index_entry, elem) : NULL;
+}
+
+/* Builds name index of directory INODE from its entries. Returns a
+   null pointer if memory is short. Caller must hold INODE's directory
+   lock. */
+static struct dir_index *
+build_index (struct inode *inode)
+{
+  struct dir_index *index;
+  struct dir_entry e;
+  off_t ofs;
+
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    return NULL;
+  if (!hash_init (&index->names, index_hash, index_less, NULL))
+    {
+      free (index);
+      return NULL;
+    }
+  index->used = bitmap_create (inode_length (inode) / sizeof e + 1);
+  if (index->used == NULL)
+    {
+      hash_destroy (&index->names, NULL);
+      free (index);
+      return NULL;
+    }
+  index->sector = inode_get_inumber (inode);
+  rwlock_init (&index->lock);
+  index->stale = false;
+  index->ref_cnt = 1;
+  index->cached = false;
+
+  for (ofs = 0; inode_read_at (inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use && !index_insert (index, &e, ofs))
+      {
+        index_destroy (index);
+        return NULL;
+      }
+  return index;
+}
+
+/* Returns name index of DIR with a reference taken, which the caller
+   must release with index_release(). The index is built from DIR's
+   entries if it is not cached. Returns a null pointer if memory is
+   short, and then callers scan DIR's entries instead. Caller must
+   hold DIR's lock. */
+static struct dir_index *
+get_index (const struct dir *dir)
+{
+  block_sector_t sector = inode_get_inumber (dir->inode);
+  struct dir_index *index, *victim;
+  struct hash_elem *old;
+  struct list_elem *e;
+
+  lock_acquire (&index_cache_lock);
+  index = index_cache_find (sector);
+  lock_release (&index_cache_lock);
+  if (index != NULL)
+    return index;
+
+  /* Build without index_cache_lock, so that other directories' indexes
+     can be used meanwhile. Another reader of DIR may build the same
+     index; the first one inserted wins. */
+  index = build_index (dir->inode);
+  if (index == NULL)
+    return NULL;
+
+  lock_acquire (&index_cache_lock);
+  old = hash_insert (&index_cache, &index->elem);
+  if (old != NULL)
+    {
+      victim = index;
+      index = hash_entry (old, struct dir_index, elem);
+      index->ref_cnt++;
+      lock_release (&index_cache_lock);
+      index_destroy (victim);
+      return index;
+    }
+  list_push_front (&index_lru, &index->lru_elem);
+  index->cached = true;
+  index_cache_cnt++;
+
+  /* A directory removed while it was being built must not leave its
+     index behind, since dir_remove() purged it before it was
+     inserted. */
+  if (inode_is_removed (dir->inode))
+    {
+      index_uncache (index);
+      index->stale = true;
+    }
+
+  /* Evict least recently used indexes that are not in use. */
+  e = list_rbegin (&index_lru);
+  while (index_cache_cnt > INDEX_CACHE_CNT && e != list_rend (&index_lru))
+    {
+      victim = list_entry (e, struct dir_index, lru_elem);
+      e = list_prev (e);
+      if (victim->ref_cnt == 0)
+        {
+          index_uncache (victim);
+          index_destroy (victim);
+        }
+    }
+  lock_release (&index_cache_lock);
+  return index;
+}
+
+/* Returns name index of DIR with a reference taken, which the caller
+   must release with dir_index_release(), for walking paths that start
+   at DIR. Returns a null pointer if memory is short. */
+struct dir_index *
+dir_index_get (struct dir *dir)
+{
+  struct dir_index *index;
+
+  inode_lock_dir (dir->inode, false);
+  index = get_index (dir);
+  inode_unlock_dir (dir->inode);
+  return index;
+}
+
+/* Returns name index of the subdirectory NAME of the directory whose
+   index is INDEX, with a reference taken. The subdirectory is opened
+   only if its index is not cached. Returns a null pointer if there is
+   no such subdirectory, INDEX is stale, or memory is short. INDEX
+   stays referenced. */
+struct dir_index *
+dir_index_step (struct dir_index *index, const char *name)
+{
+  struct dir_index *child = NULL;
+  struct index_entry *ie;
+  struct inode *inode = NULL;
+  struct dir dir;
+
+  /* Open the subdirectory while NAME still refers to it, so that it is
+     not removed and freed before its index is built. Only directories
+     have indexes, so a cached one is never a file's. */
+  rwlock_acquire_read (&index->lock);
+  ie = index->stale ? NULL : index_find (index, name);
+  if (ie != NULL)
+    {
+      lock_acquire (&index_cache_lock);
+      child = index_cache_find (ie->inode_sector);
+      lock_release (&index_cache_lock);
+      if (child == NULL)
+        inode = inode_open (ie->inode_sector);
+    }
+  rwlock_release (&index->lock);
+
+  if (inode != NULL && !is_inode_file (inode))
+    {
+      dir.inode = inode;
+      dir.pos = 0;
+      inode_lock_dir (inode, false);
+      child = get_index (&dir);
+      inode_unlock_dir (inode);
+    }
+  inode_close (inode);
+  return child;
+}
+
+/* Opens and returns the directory whose name index is INDEX. Returns
+   a null pointer if it has been removed meanwhile or memory is short. */
+struct dir *
+dir_index_open (struct dir_index *index)
+{
+  struct inode *inode = NULL;
+
+  /* INDEX is made stale before its directory can be freed, so the
+     directory is there while INDEX is not stale. */
+  rwlock_acquire_read (&index->lock);
+  if (!index->stale)
+    inode = inode_open (index->sector);
+  rwlock_release (&index->lock);
+  return dir_open (inode);
+}
+
+/* Releases INDEX returned by dir_index_get() or dir_index_step().
+   INDEX may be a null pointer. */
+void
+dir_index_release (struct dir_index *index)
+{
+  index_release (index);
+}
+
+/* Check if directroy of 'inode' is empty or not.
    Return true if it is empty, false otherwise. Ignore directory entries
-   '.' and '..'. */
+   '.' and '..'. Caller holds lock of its parent directory. */
 static bool
-is_dir_empty (struct dir *dir, const char *name)
+is_dir_empty (struct inode *inode)
 {
   struct dir_entry e;
   size_t ofs;
-  struct inode *new_inode;
   int count = 0;
-  if (!dir_lookup(dir, name, &new_inode))
-    return false;
-  for (ofs = 0; inode_read_at (new_inode, &e, sizeof e, ofs) == sizeof e;
+  inode_lock_dir (inode, false);
+  for (ofs = 0; inode_read_at (inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e)
     if (e.in_use)
       {
         count++;
       }
+  inode_unlock_dir (inode);
 
   /* If directory has only two entries ('.' and '..') */
   if (count == 2)
@@ -113,32 +549,97 @@ is_dir_empty (struct dir *dir, const char *name)
 
 }
 
+/* Searches DIR for a file with the given NAME by scanning its
+   entries, like lookup().
+   Entries are inspected in place in the buffer cache, one sector at a
+   time. Only an entry that straddles two sectors is copied out. */
+static bool
+lookup_scan (const struct dir *dir, const char *name,
+             struct dir_entry *ep, off_t *ofsp) 
+{
+  struct dir_entry e;
+  off_t ofs = 0;
+  off_t length = inode_length (dir->inode);
+  
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  while (ofs + (off_t) sizeof e <= length)
+    {
+      off_t sector_ofs = ofs - ofs % BLOCK_SECTOR_SIZE;
+      off_t sector_end = sector_ofs + BLOCK_SECTOR_SIZE;
+      const uint8_t *sector = inode_pin_at (dir->inode, sector_ofs);
+      bool found = false;
+
+      /* Entries lying entirely in this sector. */
+      for (; ofs + (off_t) sizeof e <= sector_end
+             && ofs + (off_t) sizeof e <= length; ofs += sizeof e)
+        {
+          const struct dir_entry *p =
+            (const struct dir_entry *) (sector + ofs - sector_ofs);
+          if (p->in_use && !strcmp (name, p->name))
+            {
+              e = *p;
+              found = true;
+              break;
+            }
+        }
+      inode_unpin_at (dir->inode, sector_ofs, sector);
+
+      /* Entry crossing the sector boundary. */
+      if (!found && ofs < sector_end && ofs + (off_t) sizeof e <= length)
+        {
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            break;
+          found = e.in_use && !strcmp (name, e.name);
+          if (!found)
+            ofs += sizeof e;
+        }
+
+      if (found)
+        {
+          if (ep != NULL)
+            *ep = e;
+          if (ofsp != NULL)
+            *ofsp = ofs;
+          return true;
+        }
+    }
+  return false;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   Name is looked up in INDEX, DIR's name index from get_index(), or
+   if it is null, by scanning DIR's entries.
+   Caller must hold DIR's lock (see inode_lock_dir()). */
 static bool
-lookup (const struct dir *dir, const char *name,
+lookup (const struct dir *dir, struct dir_index *index, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
-  
+  struct index_entry *ie;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  if (index == NULL)
+    return lookup_scan (dir, name, ep, ofsp);
+
+  ie = index_find (index, name);
+  if (ie == NULL)
+    return false;
+  if (ep != NULL)
+    {
+      ep->inode_sector = ie->inode_sector;
+      strlcpy (ep->name, ie->name, sizeof ep->name);
+      ep->in_use = true;
+    }
+  if (ofsp != NULL)
+    *ofsp = ie->ofs;
+  return true;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -149,15 +650,22 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  struct dir_index *index;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
+  /* Open inode before unlocking, so that it is not removed and freed
+     in between. */
+  inode_lock_dir (dir->inode, false);
+  index = get_index (dir);
+  if (lookup (dir, index, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
+  index_release (index);
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
@@ -172,6 +680,7 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
+  struct dir_index *index;
   off_t ofs;
   bool success = false;
 
@@ -182,29 +691,53 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  /* Check that NAME is not in use. The name index holds all names, so
+     it settles this without scanning DIR. */
+  inode_lock_dir (dir->inode, true);
+  index = get_index (dir);
+  if (lookup (dir, index, name, NULL, NULL))
     goto done;
 
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
-     current end-of-file.
+     current end-of-file. The name index, if any, tracks every slot in
+     use, so its first free slot is one.
      
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  if (index != NULL)
+    {
+      size_t slot = bitmap_scan (index->used, 0, 1, false);
+      if (slot == BITMAP_ERROR)
+        slot = bitmap_size (index->used);
+      ofs = slot * sizeof e;
+    }
+  else
+    for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+         ofs += sizeof e) 
+      if (!e.in_use)
+        break;
 
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (success && index != NULL)
+    {
+      bool indexed;
+
+      rwlock_acquire_write (&index->lock);
+      indexed = index_insert (index, &e, ofs);
+      rwlock_release (&index->lock);
+      if (!indexed)
+        index_drop (index);
+    }
 
  done:
+  index_release (index);
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
@@ -215,6 +748,7 @@ bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
+  struct dir_index *index = NULL;
   struct inode *inode = NULL;
   bool success = false;
   off_t ofs;
@@ -222,8 +756,16 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  /* "." and ".." name DIR itself and its parent, which are never
+     removed through DIR, and whose locks must not be taken while
+     DIR's is held. */
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  inode_lock_dir (dir->inode, true);
+  index = get_index (dir);
+  if (!lookup (dir, index, name, &e, &ofs))
     goto done;
 
   /* Open inode. */
@@ -235,7 +777,7 @@ dir_remove (struct dir *dir, const char *name)
      and if directory, check if it is empty or not.
      (Only empty directory can be removed.) */
   if (!is_inode_file(inode)) {
-    if (!is_dir_empty(dir, name))
+    if (!is_dir_empty(inode))
       goto done;
   }
 
@@ -247,24 +789,42 @@ dir_remove (struct dir *dir, const char *name)
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  if (index != NULL)
+    {
+      struct index_entry *ie;
+
+      rwlock_acquire_write (&index->lock);
+      ie = index_find (index, name);
+      hash_delete (&index->names, &ie->elem);
+      bitmap_reset (index->used, ofs / sizeof e);
+      rwlock_release (&index->lock);
+      free (ie);
+    }
 
-  /* Remove inode. */
+  /* Remove inode, and then drop its index if it is a directory. */
   inode_remove (inode);
+  if (!is_inode_file (inode))
+    index_purge (e.inode_sector);
   success = true;
 
  done:
+  index_release (index);
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries. NAME may be user memory, so it is
+   written after DIR is unlocked. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
+  inode_lock_dir (dir->inode, false);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
@@ -272,13 +832,54 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
         {
           /* readdir ignore entries '.' and '..' */
           if ((strcmp(e.name, ".") != 0) && (strcmp(e.name, "..") != 0)) {
-            strlcpy (name, e.name, NAME_MAX + 1);
-            return true;
+            found = true;
+            break;
           }
         } 
     }
+  inode_unlock_dir (dir->inode);
 
-  return false;
+  if (found)
+    strlcpy (name, e.name, NAME_MAX + 1);
+  return found;
+}
+
+/* Number of entries read from disk at a time by dir_getdents(). */
+#define GETDENTS_READ 8
+
+/* Reads up to CNT entries of DIR into ENTS, continuing from DIR's
+   position, like dir_readdir(). ENTS must be kernel memory. Entries are
+   read from the directory several at a time, and each gets its inode
+   number and type. Returns the number of entries read, which is 0 if
+   the directory contains no more entries. */
+size_t
+dir_getdents (struct dir *dir, struct dirent *ents, size_t cnt)
+{
+  struct dir_entry e[GETDENTS_READ];
+  size_t n = 0, i;
+
+  inode_lock_dir (dir->inode, false);
+  while (n < cnt)
+    {
+      /* At most CNT - N entries are read, so all in use are taken. */
+      size_t want = cnt - n < GETDENTS_READ ? cnt - n : GETDENTS_READ;
+      size_t got = inode_read_at (dir->inode, e, want * sizeof *e, dir->pos)
+                   / sizeof *e;
+      if (got == 0)
+        break;
+      dir->pos += got * sizeof *e;
+      for (i = 0; i < got; i++)
+        if (e[i].in_use && strcmp (e[i].name, ".")
+            && strcmp (e[i].name, ".."))
+          {
+            ents[n].inumber = e[i].inode_sector;
+            ents[n].isdir = inode_probe_dir (e[i].inode_sector);
+            strlcpy (ents[n].name, e[i].name, sizeof ents[n].name);
+            n++;
+          }
+    }
+  inode_unlock_dir (dir->inode);
+  return n;
 }
 
 /* Add two special directory entries ('.' and '..') when directory is being
@@ -6,6 +6,8 @@
 #include "devices/block.h"
 #include "filesys/off_t.h"
 
+struct dirent;
+
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
    After directories are implemented, this maximum length may be
@@ -13,6 +15,9 @@
 #define NAME_MAX 14
 
 struct inode;
+struct dir_index;
+
+void dir_init (void);
 
 /* Opening and closing directories. */
 bool dir_create (block_sector_t sector, size_t entry_cnt);
@@ -27,6 +32,13 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_getdents (struct dir *, struct dirent *, size_t cnt);
+
+/* Walking paths through directories' name indexes. */
+struct dir_index *dir_index_get (struct dir *);
+struct dir_index *dir_index_step (struct dir_index *, const char *name);
+struct dir *dir_index_open (struct dir_index *);
+void dir_index_release (struct dir_index *);
 
 /* Add special directory entries */
 bool dir_add_basic (struct dir *, struct dir *);
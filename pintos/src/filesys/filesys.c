@@ -9,7 +9,6 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
-#include "threads/malloc.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -26,12 +25,15 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  dir_init ();
   free_map_init ();
 
   bc_init();
 
   if (format) 
     do_format ();
+  else
+    inode_extents = inode_probe_extents (ROOT_DIR_SECTOR);
 
   free_map_open ();
   struct dir *rootdir = dir_open_root();
@@ -44,83 +46,117 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
-  bc_exit();
   free_map_close ();
+  bc_exit();
+}
+
+/* Extracts a file name component from *SRCP into PART, and
+   updates *SRCP so that the next call will return the next
+   component. Walks the string in place, without copying it.
+   Returns 1 if successful, 0 at end of string (PART is then
+   empty), -1 for a too-long component. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes. If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    {
+      *part = '\0';
+      return 0;
+    }
+
+  /* Copy up to NAME_MAX character from SRC to DST. Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
 }
 
+/* Resolves path NAME, which is absolute or relative to the current
+   directory, one component at a time. Opens and returns the directory
+   holding its last component, and copies the last component into
+   FILENAME, which must have room for NAME_MAX + 1 bytes. FILENAME is
+   empty if NAME names the root directory. Returns a null pointer if a
+   directory on the way does not exist, a component is too long, or
+   memory is short.
+   Allocates no memory for NAME. */
 struct dir *
 parse_path(const char *name, char *filename)
 {
-  /* Copy name to name_cp for tokenizing */
-  char *name_cp = calloc(1, strlen(name)+1);
-  char *tmp = name_cp;
-  strlcpy(name_cp, name, strlen(name)+1);
+  return parse_path_at(thread_current()->directory, name, filename);
+}
+
+/* Like parse_path(), but a relative NAME is resolved starting at BASE
+   instead of the current directory. BASE stays open. */
+struct dir *
+parse_path_at(struct dir *base, const char *name, char *filename)
+{
+  char part[NAME_MAX + 1], next[NAME_MAX + 1];
+  struct dir_index *index = NULL, *next_index;
   struct dir *dir;
-  char *token, *save_ptr;
+  int result;
 
   /* If name contains root dir or not */
-  if (name_cp[0] == '/') {
+  if (name[0] == '/')
     dir = dir_open_root();
-    name_cp++;
-    while (name_cp[0] == '/')
-      name_cp++;
-  }
   else {
-    if (thread_current()->directory == NULL) {
-      free(tmp);
+    if (base == NULL)
       return NULL;
-    }
-    dir = dir_reopen(thread_current()->directory);
-  }
-
-  /* If name contains just root dir sign (/) */
-  if (strlen(name_cp) == 0) {
-    free(tmp);
-    return dir;
-  }
-
-  /* Iterate to find how many chunks in name */
-  int count = 0, i = 0;
-  char *iter = name_cp;
-  while(*iter != '\0') {
-    if (*iter == '/') {
-      while (*iter == '/')
-        iter++;
-      count++;
-      continue;
-    }
-    iter++;
-  }
-  count++;
-
-  /* Parse and tokenize name */
-  char *parse[count];
-  for (token = strtok_r (name_cp, "/", &save_ptr); token != NULL;
-        token = strtok_r (NULL, "/", &save_ptr)) {
-    /* Continue if // */
-    if (strlen(token) == 0)
-      continue;
-    parse[i] = token;
-    i++;
+    dir = dir_reopen(base);
   }
+  if (dir == NULL)
+    return NULL;
 
-  /* Get directory */
-  struct inode *inode;
-  for (i = 0; i < count - 1 ; i++) {
-    if (!dir_lookup(dir, parse[i], &inode)) {
-      free(tmp);
+  /* Walk the directories on the way through their name indexes,
+     looking one component ahead to find the last one. Only the
+     directory holding the last component is opened. */
+  result = get_next_part(part, &name);
+  while (result > 0) {
+    result = get_next_part(next, &name);
+    if (result <= 0)
+      break;
+    if (index == NULL)
+      index = dir_index_get(dir);
+    next_index = index != NULL ? dir_index_step(index, part) : NULL;
+    dir_index_release(index);
+    index = next_index;
+    if (index == NULL) {
       dir_close(dir);
       return NULL;
     }
+    strlcpy(part, next, sizeof part);
+  }
+  if (result < 0) {
+    dir_index_release(index);
     dir_close(dir);
-    dir = dir_open(inode);
+    return NULL;
+  }
+  if (index != NULL) {
+    dir_close(dir);
+    dir = dir_index_open(index);
+    dir_index_release(index);
+    if (dir == NULL)
+      return NULL;
   }
 
   /* Copy filename into filename */
   if (filename != NULL)
-    strlcpy(filename, parse[i], strlen(parse[i])+1);
-
-  free(tmp);
+    strlcpy(filename, part, NAME_MAX + 1);
   return dir;
 }
 
@@ -132,8 +168,7 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  //struct dir *dir = dir_open_root ();
-  char *filename = calloc(1, strlen(name) + 1);
+  char filename[NAME_MAX + 1];
   struct dir *dir = parse_path(name, filename);
   bool success = (dir != NULL
                   && free_map_allocate (1, &inode_sector)
@@ -142,7 +177,6 @@ filesys_create (const char *name, off_t initial_size)
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
-  free(filename);
   return success;
 }
 
@@ -151,26 +185,37 @@ filesys_create (const char *name, off_t initial_size)
    exists, or if internal memory allocation fails. */
 bool
 filesys_create_dir (const char *name)
+{
+  return filesys_create_dir_at (thread_current ()->directory, name);
+}
+
+/* Like filesys_create_dir(), but a relative NAME is resolved
+   starting at directory BASE. */
+bool
+filesys_create_dir_at (struct dir *base, const char *name)
 {
   block_sector_t inode_sector = 0;
   char dirname[NAME_MAX + 1];
-  struct dir *dir = parse_path(name, dirname);
+  struct dir *dir = parse_path_at(base, name, dirname);
   bool success = (dir != NULL
                   && free_map_allocate (1, &inode_sector)
                   && dir_create (inode_sector, 16)
                   && dir_add (dir, dirname, inode_sector));
 
-  if (!success && inode_sector != 0) {
-    free_map_release (inode_sector, 1);
-    return success;
+  if (!success) {
+    if (inode_sector != 0)
+      free_map_release (inode_sector, 1);
+    dir_close (dir);
+    return false;
   }
 
-  struct inode *new_inode;
-  dir_lookup(dir, dirname, &new_inode);
-  struct dir *new_dir = dir_open(new_inode);
-  if (new_dir == NULL) return false;
+  struct inode *new_inode = NULL;
+  struct dir *new_dir = NULL;
+  if (dir_lookup(dir, dirname, &new_inode))
+    new_dir = dir_open(new_inode);
 
-  success = dir_add_basic(dir, new_dir);
+  success = new_dir != NULL && dir_add_basic(dir, new_dir);
+  dir_close (new_dir);
   dir_close (dir);
 
   return success;
@@ -184,29 +229,32 @@ filesys_create_dir (const char *name)
 struct file *
 filesys_open (const char *name)
 {
-  if (strlen(name) == 0)
+  return filesys_open_at (thread_current ()->directory, name);
+}
+
+/* Like filesys_open(), but a relative NAME is resolved starting at
+   directory BASE. */
+struct file *
+filesys_open_at (struct dir *base, const char *name)
+{
+  if (name[0] == '\0')
     return NULL;
-  char *filename = calloc(1, strlen(name) + 1);
-  struct dir *dir = parse_path(name, filename);
+  char filename[NAME_MAX + 1];
+  struct dir *dir = parse_path_at(base, name, filename);
   struct inode *inode = NULL;
 
   /* If dir doesn't exist */
-  if (dir == NULL) {
-    free(filename);
+  if (dir == NULL)
     return NULL;
-  }
 
   /* If dir exist, but filename is empty */
-  if (strlen(filename) == 0) {
-    free(filename);
+  if (filename[0] == '\0')
     return file_open(dir_get_inode(dir));
-  }
 
   /* Normal case */
   else if (dir != NULL)
     dir_lookup (dir, filename, &inode);
   dir_close (dir);
-  free(filename);
 
   return file_open (inode);
 }
@@ -217,16 +265,23 @@ filesys_open (const char *name)
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
+{
+  return filesys_remove_at (thread_current ()->directory, name);
+}
+
+/* Like filesys_remove(), but a relative NAME is resolved starting at
+   directory BASE. */
+bool
+filesys_remove_at (struct dir *base, const char *name)
 {
   //struct dir *dir = dir_open_root ();
   bool success = false;
   if (!strcmp(name, ".") || !strcmp(name, ".."))
     return success;
-  char *filename = calloc(1, strlen(name) + 1);
-  struct dir *dir = parse_path(name, filename);
+  char filename[NAME_MAX + 1];
+  struct dir *dir = parse_path_at(base, name, filename);
   success = dir != NULL && dir_remove (dir, filename);
   dir_close (dir); 
-  free(filename);
 
   return success;
 }
@@ -15,9 +15,13 @@ struct block *fs_device;
 void filesys_init (bool format);
 void filesys_done (void);
 struct dir *parse_path(const char *name, char *filename);
+struct dir *parse_path_at(struct dir *base, const char *name, char *filename);
 bool filesys_create (const char *name, off_t initial_size);
 bool filesys_create_dir (const char *name);
+bool filesys_create_dir_at (struct dir *base, const char *name);
 struct file *filesys_open (const char *name);
+struct file *filesys_open_at (struct dir *base, const char *name);
 bool filesys_remove (const char *name);
+bool filesys_remove_at (struct dir *base, const char *name);
 
 #endif /* filesys/filesys.h */
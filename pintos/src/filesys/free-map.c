@@ -1,13 +1,36 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors of free_map_file that differ from free_map, one bit per
+   sector of the file. Changes to free_map are written to the file
+   lazily by free_map_flush(), only for these sectors. */
+static struct bitmap *free_map_dirty;
+
+/* Protects free_map and free_map_dirty, and orders writes to
+   free_map_file. */
+static struct lock free_map_lock;
+
+static void flush_dirty (void);
+
+/* Marks sectors of free_map_file holding bits of CNT sectors starting
+   at SECTOR dirty. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / 8 / BLOCK_SECTOR_SIZE;
+  size_t last = (sector + cnt - 1) / 8 / BLOCK_SECTOR_SIZE;
+  bitmap_set_multiple (free_map_dirty, first, last - first + 1, true);
+}
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
@@ -17,36 +40,122 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  free_map_dirty = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                                BLOCK_SECTOR_SIZE));
+  if (free_map_dirty == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
+  lock_acquire (&free_map_lock);
   block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
-    {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
-    }
+  if (sector != BITMAP_ERROR)
+    mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates a run of at most CNT consecutive sectors from the free
+   map, preferring one at or after sector HINT, and stores the first
+   into *SECTORP.  The whole CNT sectors are tried first, and the
+   run is halved while no run that long is free.
+   Returns the number of sectors allocated, which is 0 if the disk
+   is full. */
+size_t
+free_map_allocate_run (size_t cnt, block_sector_t hint,
+                       block_sector_t *sectorp)
+{
+  size_t sector = BITMAP_ERROR;
+
+  if (hint > bitmap_size (free_map))
+    hint = 0;
+  lock_acquire (&free_map_lock);
+  for (; cnt > 0; cnt /= 2)
+    {
+      sector = bitmap_scan_and_flip (free_map, hint, cnt, false);
+      if (sector == BITMAP_ERROR && hint != 0)
+        sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+      if (sector == BITMAP_ERROR)
+        continue;
+
+      mark_dirty (sector, cnt);
+      break;
+    }
+  lock_release (&free_map_lock);
+  if (cnt > 0)
+    *sectorp = sector;
+  return cnt;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Writes dirty sectors of the free map to free_map_file, each run of
+   consecutive dirty sectors in one write. Must be called with
+   free_map_lock held. */
+static void
+flush_dirty (void)
+{
+  size_t size = bitmap_size (free_map_dirty);
+  size_t start, cnt;
+
+  if (free_map_file == NULL)
+    return;
+  for (start = 0; start < size; start += cnt)
+    {
+      start = bitmap_scan (free_map_dirty, start, 1, true);
+      if (start == BITMAP_ERROR)
+        break;
+      for (cnt = 1; start + cnt < size
+                    && bitmap_test (free_map_dirty, start + cnt); cnt++)
+        continue;
+      if (bitmap_write_partial (free_map, free_map_file,
+                                start * BLOCK_SECTOR_SIZE,
+                                cnt * BLOCK_SECTOR_SIZE))
+        bitmap_set_multiple (free_map_dirty, start, cnt, false);
+    }
+}
+
+/* Writes changes of the free map since the last flush to the free map
+   file, through the buffer cache. Called by the write-behind flusher and
+   when the free map file is closed. */
+void
+free_map_flush (void)
+{
+  lock_acquire (&free_map_lock);
+  flush_dirty ();
+  lock_release (&free_map_lock);
+}
+
+/* Writes changes of the free map all the way to disk, like
+   free_map_flush() followed by writing back the free map file's cached
+   sectors. Used by fsync(), so that sectors a file was given are not
+   still free on disk after the file is. */
+void
+free_map_sync (void)
+{
+  lock_acquire (&free_map_lock);
+  flush_dirty ();
+  if (free_map_file != NULL)
+    inode_flush (file_get_inode (free_map_file));
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -64,7 +173,11 @@ free_map_open (void)
 void
 free_map_close (void) 
 {
+  lock_acquire (&free_map_lock);
+  flush_dirty ();
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -72,14 +185,22 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct file *file;
+
   /* Create inode. */
   if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), true))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file. File is created as a hole, so this write
+     allocates its sectors, which must not happen while free_map_lock is
+     held for flushing. Bits of those sectors are set before the data is
+     copied, so the file is up to date afterward, and never needs
+     allocation again. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (free_map, file))
     PANIC ("can't write free map");
+  bitmap_set_all (free_map_dirty, false);
+  free_map_file = file;
 }
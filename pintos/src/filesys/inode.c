@@ -1,8 +1,9 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include "devices/block.h"
 #include "filesys/filesys.h"
@@ -14,24 +15,104 @@
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Identifies an extent-based inode. */
+#define EXTENT_MAGIC 0x45585431
+
 /* Block number in inode_disk */
-#define DIRECT_BLOCK_ENTRIES 123
+#define DIRECT_BLOCK_ENTRIES 122
 #define INDIRECT_BLOCK_ENTRIES 128
 
+/* Number of extents in extent-based inode_disk and in extent block. */
+#define INODE_EXTENTS 40
+#define EXTENT_BLOCK_ENTRIES 42
+
+/* Slots of in-memory block map: indirect table, double indirect table,
+   and then INDIRECT_BLOCK_ENTRIES tables pointed by double indirect. */
+#define MAP_INDIRECT 0
+#define MAP_DOUBLE 1
+#define MAP_TABLES (2 + INDIRECT_BLOCK_ENTRIES)
+
+/* Bytes of data stored in inode_disk itself by inline inodes, in place of
+   block pointers. */
+#define INLINE_BYTES ((DIRECT_BLOCK_ENTRIES + 2) * sizeof (block_sector_t))
+
+/* Bytes of inline data copied at a time through a bounce buffer on
+   the stack. */
+#define INLINE_CHUNK 128
+
+/* Flags of inode_disk. */
+#define INODE_INLINE 0x1                /* Data is in inline_data. */
+
+/* Max number of sectors allocated as one run when filling holes. */
+#define EXTEND_RUN_MAX 256
+
+/* Read-ahead window size in sectors. */
+#define READ_AHEAD_MIN 2
+#define READ_AHEAD_MAX 16
+
+/* Run of CNT sectors starting at disk sector START, holding file's
+   sectors FILE_SECTOR to FILE_SECTOR + CNT - 1. */
+struct extent
+  {
+    uint32_t file_sector;               /* First sector index in file. */
+    block_sector_t start;               /* First disk sector. */
+    uint32_t cnt;                       /* Number of sectors. */
+  };
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   Block pointers are stored either in direct, indirect, and double
+   indirect tables (INODE_MAGIC), or as extents (EXTENT_MAGIC). Format of
+   new inodes is chosen at format time (see inode_extents). A file of at
+   most INLINE_BYTES bytes keeps its data in inline_data instead, with
+   INODE_INLINE set in flags, and moves it to a data sector when it
+   grows larger. */
 struct inode_disk
   {
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
     uint32_t isfile;			/* Indicating if it is file. */
+    uint32_t flags;                     /* INODE_* flags. */
 
-    /* Block pointers of direct, indirect, and double indirect. */
-    block_sector_t direct_block[DIRECT_BLOCK_ENTRIES];
-    block_sector_t indirect_block;
-    block_sector_t double_indirect_block;
+    union
+      {
+        /* Block pointers of direct, indirect, and double indirect. */
+        struct
+          {
+            block_sector_t direct_block[DIRECT_BLOCK_ENTRIES];
+            block_sector_t indirect_block;
+            block_sector_t double_indirect_block;
+          };
+
+        /* Extents, sorted by file sector. Extents past first
+           INODE_EXTENTS are kept in a chain of extent blocks, all full
+           but the last. */
+        struct
+          {
+            uint32_t extent_cnt;        /* Number of extents in all. */
+            block_sector_t extent_head; /* First extent block, or 0. */
+            block_sector_t extent_tail; /* Last extent block, or 0. */
+            struct extent extents[INODE_EXTENTS];
+            uint32_t unused[1];
+          };
+
+        /* File data, if INODE_INLINE. */
+        uint8_t inline_data[INLINE_BYTES];
+      };
+  };
+
+/* Extent block. Holds extents that do not fit in inode_disk. */
+struct extent_block
+  {
+    uint32_t cnt;                       /* Number of extents used. */
+    block_sector_t next;                /* Next extent block, or 0. */
+    struct extent extents[EXTENT_BLOCK_ENTRIES];
   };
 
+/* If true, inode_create() makes extent-based inodes. Set by "-extents"
+   when formatting, and from the root directory inode when mounting. */
+bool inode_extents;
+
 /* Structure of indirect block. It contains 128 direct block pointers. */
 struct inode_indirect_block
   {
@@ -46,75 +127,156 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Returns true if DISK_INODE stores extents. */
+static inline bool
+is_extent_inode (const struct inode_disk *disk_inode)
+{
+  return disk_inode->magic == EXTENT_MAGIC;
+}
+
+/* Returns true if DISK_INODE stores its data inline. */
+static inline bool
+is_inline_inode (const struct inode_disk *disk_inode)
+{
+  return (disk_inode->flags & INODE_INLINE) != 0;
+}
+
 /* Function prototypes */
-static bool inode_extend_file(struct inode_disk *, off_t);
+static bool inode_allocate (struct inode *, off_t, off_t);
+static block_sector_t extent_to_sector (const struct inode_disk *, off_t);
+static bool extent_insert (struct inode_disk *, uint32_t, block_sector_t,
+                           uint32_t);
+static void extent_flush (struct inode_disk *);
+static void extent_free (struct inode_disk *);
 static void free_inode_sectors (struct inode_disk *);
+static void inode_read_ahead (struct inode *, off_t, off_t);
 
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool loaded;                        /* True once data is read in. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct lock extend_lock;		/* Use for extending file length. */
+    struct rwlock rwlock;		/* Protects length and block pointers. */
+    struct rwlock dir_lock;		/* Protects directory entries. */
+    off_t ra_next;			/* Offset expected by sequential read. */
+    off_t ra_end;			/* Sector index read ahead so far. */
+    size_t ra_window;			/* Read-ahead window in sectors. */
+    struct lock map_lock;		/* Protects map. */
+    block_sector_t **map;		/* Copies of index tables. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Returns entry IDX of index table at TABLE_SECTOR, which is cached in
+   SLOT of INODE's block map. Table is copied from buffer cache on first
+   use and then looked up in memory. inode_allocate() drops the map after
+   changing index tables. If memory is short, entry is read from buffer
+   cache without copy. Returns -1 if index table is not allocated yet or
+   entry is a hole. */
+static block_sector_t
+map_lookup (struct inode *inode, int slot, block_sector_t table_sector,
+            size_t idx)
+{
+  block_sector_t *table = NULL;
+  block_sector_t result;
+
+  if (table_sector == 0 || table_sector == (block_sector_t) -1)
+    return -1;
+
+  lock_acquire (&inode->map_lock);
+  if (inode->map == NULL)
+    inode->map = calloc (MAP_TABLES, sizeof *inode->map);
+  if (inode->map != NULL)
+    {
+      table = inode->map[slot];
+      if (table == NULL && (table = malloc (BLOCK_SECTOR_SIZE)) != NULL)
+        {
+          inode->map[slot] = table;
+          bc_read (table_sector, table, BLOCK_SECTOR_SIZE, 0);
+        }
+    }
+
+  if (table == NULL)
+    bc_read (table_sector, &result, sizeof result, idx * sizeof result);
+  else
+    result = table[idx];
+  lock_release (&inode->map_lock);
+  return result != 0 ? result : (block_sector_t) -1;
+}
+
+/* Frees INODE's block map. */
+static void
+map_destroy (struct inode *inode)
+{
+  int i;
+
+  lock_acquire (&inode->map_lock);
+  if (inode->map != NULL)
+    {
+      for (i = 0; i < MAP_TABLES; i++)
+        free (inode->map[i]);
+      free (inode->map);
+      inode->map = NULL;
+    }
+  lock_release (&inode->map_lock);
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, that is, if POS is in a hole. */
 static block_sector_t
-byte_to_sector (const struct inode_disk *inode_disk, off_t pos)
+byte_to_sector (struct inode *inode, off_t pos)
 {
-  ASSERT (inode_disk != NULL);
-  ASSERT (pos <= inode_disk->length)
+  ASSERT (inode != NULL);
+  ASSERT (pos <= inode->data.length)
+
+  const struct inode_disk *inode_disk = &inode->data;
 
   off_t pos_sector = pos / BLOCK_SECTOR_SIZE;
   block_sector_t result_sec;
 
+  if (is_inline_inode (inode_disk))
+    return -1;
+  if (is_extent_inode (inode_disk))
+    return extent_to_sector (inode_disk, pos_sector);
+
   /* Direct Access */
   if (pos_sector < DIRECT_BLOCK_ENTRIES)
   {
     result_sec = inode_disk->direct_block[pos_sector];
+    if (result_sec == 0)
+      result_sec = -1;
   }
   /* Indirect Access */
   else if (pos_sector < (off_t)(DIRECT_BLOCK_ENTRIES + INDIRECT_BLOCK_ENTRIES))
   {
-    struct inode_indirect_block *indirect = malloc(sizeof *indirect);
-    off_t index1, remain;
-    if (indirect == NULL)
-      return -1;
+    off_t remain;
 
-    /* Get indirect block table. */
-    index1 = inode_disk->indirect_block;
+    /* Look up indirect block table in block map. */
     remain = pos_sector - DIRECT_BLOCK_ENTRIES;
-    bc_read(index1, indirect, BLOCK_SECTOR_SIZE, 0);
-    result_sec = indirect->table[remain];
-    free(indirect);
+    result_sec = map_lookup (inode, MAP_INDIRECT,
+                             inode_disk->indirect_block, remain);
   }
   /* Double Indirect Access */
   else if (pos_sector < (off_t)(DIRECT_BLOCK_ENTRIES +
 			INDIRECT_BLOCK_ENTRIES * (INDIRECT_BLOCK_ENTRIES + 1)))
   {
-    struct inode_indirect_block *indirect = malloc(sizeof *indirect);
-    off_t index1, index2, remain;
-    if (indirect == NULL)
-      return -1;
+    off_t index2, remain;
 
-    /* Get double indirect block table. */
-    index1 = inode_disk->double_indirect_block;
+    /* Look up double indirect block table in block map. */
     remain = pos_sector - (DIRECT_BLOCK_ENTRIES + INDIRECT_BLOCK_ENTRIES);
-    bc_read(index1, indirect, BLOCK_SECTOR_SIZE, 0);
-
-    /* Get indirect block table. */
-    index2 = indirect->table[remain / INDIRECT_BLOCK_ENTRIES];
-    remain %= INDIRECT_BLOCK_ENTRIES;
-    bc_read(index2, indirect, BLOCK_SECTOR_SIZE, 0);
-    result_sec = indirect->table[remain];
-    free(indirect);
+    index2 = map_lookup (inode, MAP_DOUBLE,
+                         inode_disk->double_indirect_block,
+                         remain / INDIRECT_BLOCK_ENTRIES);
+
+    /* Look up indirect block table in block map. */
+    result_sec = map_lookup (inode,
+                             MAP_DOUBLE + 1 + remain / INDIRECT_BLOCK_ENTRIES,
+                             index2, remain % INDIRECT_BLOCK_ENTRIES);
   }
   /* INODE does not contain data for a byte at offset POS. */
   else
@@ -125,20 +287,43 @@ byte_to_sector (const struct inode_disk *inode_disk, off_t pos)
   return result_sec;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects open_inodes and open_cnt of open inodes. */
+static struct lock open_inodes_lock;
+
+/* Hash function of open_inodes. Hash by inode sector. */
+static unsigned
+inode_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int ((int) hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Compare two open inodes by sector. */
+static bool
+inode_less_func (const struct hash_elem *a, const struct hash_elem *b,
+                 void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash_func, inode_less_func, NULL))
+    PANIC ("open inode table creation failed");
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device. Data is a hole, which reads as zeros; sectors are
+   allocated when it is written. Data of at most INLINE_BYTES bytes
+   is kept inline in the inode.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
@@ -156,18 +341,17 @@ inode_create (block_sector_t sector, off_t length, bool is_file)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      disk_inode->magic = INODE_MAGIC;
+      disk_inode->magic = inode_extents ? EXTENT_MAGIC : INODE_MAGIC;
       disk_inode->indirect_block = 0;
       disk_inode->double_indirect_block = 0;
+      if (length <= (off_t) INLINE_BYTES)
+        disk_inode->flags = INODE_INLINE;
       if (is_file)
         disk_inode->isfile = REGULAR_FILE;
       else
         disk_inode->isfile = DIRECTORY;
 
-      /* Extend file, if needed. */
-      if (length > 0) {
-        inode_extend_file(disk_inode, length);
-      }
+      disk_inode->length = length;
       /* Write inode_disk to disk. */
       bc_write(sector, disk_inode, BLOCK_SECTOR_SIZE, 0);
       free (disk_inode);
@@ -182,34 +366,60 @@ inode_create (block_sector_t sector, off_t length, bool is_file)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
-
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  struct hash_elem *e;
+  struct inode *inode, key;
+
+  /* Check whether this inode is already open. If its first opener is
+     still reading it in, wait for that through its rwlock. */
+  lock_acquire (&open_inodes_lock);
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      bool loaded;
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      loaded = inode->loaded;
+      lock_release (&open_inodes_lock);
+      if (!loaded)
         {
-          inode_reopen (inode);
-          return inode; 
+          rwlock_acquire_read (&inode->rwlock);
+          rwlock_release (&inode->rwlock);
         }
+      return inode; 
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init(&inode->extend_lock);
+  inode->loaded = false;
+  rwlock_init (&inode->rwlock);
+  rwlock_init (&inode->dir_lock);
+  inode->ra_next = 0;
+  inode->ra_end = 0;
+  inode->ra_window = 0;
+  lock_init(&inode->map_lock);
+  inode->map = NULL;
+
+  /* Read inode in without open_inodes_lock, so that a cache miss does
+     not hold up every open and close. Nobody else has seen INODE yet,
+     so taking its rwlock here does not block. */
+  rwlock_acquire_write (&inode->rwlock);
+  lock_release (&open_inodes_lock);
   bc_read (inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+  inode->loaded = true;
+  rwlock_release (&inode->rwlock);
   return inode;
 }
 
@@ -218,7 +428,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -233,10 +447,13 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      /* Remove from open inode table. Nobody else can reach INODE
+         after this. */
+      hash_delete (&open_inodes, &inode->elem);
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
@@ -245,8 +462,11 @@ inode_close (struct inode *inode)
           free_map_release(inode->sector, 1);
         }
 
+      map_destroy (inode);
       free (inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -258,6 +478,110 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Returns true if INODE has been removed, false otherwise. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Looks up the sector holding byte OFFSET of INODE, and the number of
+   bytes of INODE left from OFFSET, holding INODE's lock for reading
+   only meanwhile. Data is copied without the lock, since BUFFER of
+   inode_read_at() and inode_write_at() may be user memory and page
+   fault. Returns -1 for a hole. */
+static block_sector_t
+lookup_sector (struct inode *inode, off_t offset, off_t *inode_left)
+{
+  block_sector_t sector = -1;
+
+  rwlock_acquire_read (&inode->rwlock);
+  *inode_left = inode->data.length - offset;
+  if (*inode_left > 0)
+    sector = byte_to_sector (inode, offset);
+  rwlock_release (&inode->rwlock);
+  return sector;
+}
+
+/* Copies at most SIZE bytes of inline INODE's data at OFFSET into
+   BOUNCE, which is kernel memory. Returns the number of bytes copied, or
+   -1 if INODE is not inline (anymore). */
+static off_t
+inline_read (struct inode *inode, void *bounce, off_t size, off_t offset)
+{
+  off_t bytes_read = -1;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (is_inline_inode (&inode->data))
+    {
+      off_t inode_left = inode->data.length - offset;
+      bytes_read = size < inode_left ? size : inode_left;
+      if (bytes_read < 0)
+        bytes_read = 0;
+      memcpy (bounce, inode->data.inline_data + offset, bytes_read);
+    }
+  rwlock_release (&inode->rwlock);
+  return bytes_read;
+}
+
+/* Copies SIZE bytes from BOUNCE into inline INODE's data at OFFSET,
+   which must be within its length. Returns false if INODE is not
+   inline (anymore). */
+static bool
+inline_write (struct inode *inode, const void *bounce, off_t size,
+              off_t offset)
+{
+  bool success = false;
+
+  rwlock_acquire_write (&inode->rwlock);
+  if (is_inline_inode (&inode->data))
+    {
+      ASSERT (offset + size <= inode->data.length);
+      memcpy (inode->data.inline_data + offset, bounce, size);
+      bc_write (inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+      success = true;
+    }
+  rwlock_release (&inode->rwlock);
+  return success;
+}
+
+/* Moves inline data of INODE to a newly allocated data sector, so that
+   INODE can grow beyond INLINE_BYTES. Must be called with INODE's lock
+   held for writing. Returns false if memory or disk allocation fails,
+   leaving INODE inline. */
+static bool
+inline_migrate (struct inode *inode)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  off_t length = disk_inode->length;
+  uint8_t *data = NULL;
+
+  if (length > 0)
+    {
+      data = malloc (length);
+      if (data == NULL)
+        return false;
+      memcpy (data, disk_inode->inline_data, length);
+    }
+
+  /* Zeros are empty block pointers and extents alike. */
+  memset (disk_inode->inline_data, 0, INLINE_BYTES);
+  disk_inode->flags &= ~INODE_INLINE;
+  if (length > 0)
+    {
+      if (!inode_allocate (inode, 0, length))
+        {
+          memcpy (disk_inode->inline_data, data, length);
+          disk_inode->flags |= INODE_INLINE;
+          free (data);
+          return false;
+        }
+      bc_write (byte_to_sector (inode, 0), data, length, 0);
+      free (data);
+    }
+  return true;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
@@ -267,14 +591,36 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
 
+  inode_read_ahead (inode, offset, size);
+
   while (size > 0) 
     {
+      /* Inline data is copied under INODE's lock, through a bounce
+         buffer since BUFFER may page fault. */
+      if (is_inline_inode (&inode->data))
+        {
+          uint8_t bounce[INLINE_CHUNK];
+          off_t chunk_size = inline_read (inode, bounce,
+                                          size < INLINE_CHUNK
+                                          ? size : INLINE_CHUNK, offset);
+          if (chunk_size == 0)
+            break;
+          if (chunk_size > 0)
+            {
+              memcpy (buffer + bytes_read, bounce, chunk_size);
+              size -= chunk_size;
+              offset += chunk_size;
+              bytes_read += chunk_size;
+              continue;
+            }
+        }
+
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (&inode->data, offset);
+      off_t inode_left;
+      block_sector_t sector_idx = lookup_sector (inode, offset, &inode_left);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -282,7 +628,10 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
-      bc_read(sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
+      if (sector_idx == (block_sector_t) -1)
+        memset (buffer + bytes_read, 0, chunk_size);
+      else
+        bc_read(sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
 
       /* Advance. */
       size -= chunk_size;
@@ -293,6 +642,79 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Pins the sector holding byte OFFSET of INODE in the buffer cache and
+   returns a pointer to the start of its cached data, so that caller can
+   inspect it in place without copy. If OFFSET is in a hole, a sector of
+   zeros is returned instead, and if INODE is inline, its inline data.
+   OFFSET must be less than INODE's length. INODE must not be written
+   until it is released by inode_unpin_at(), passing an offset in the
+   same sector and the returned pointer. For directories, holding the
+   directory lock ensures that. */
+static const char hole_sector[BLOCK_SECTOR_SIZE];
+
+const void *
+inode_pin_at (struct inode *inode, off_t offset)
+{
+  off_t inode_left;
+  block_sector_t sector = lookup_sector (inode, offset, &inode_left);
+
+  ASSERT (inode_left > 0);
+  if (is_inline_inode (&inode->data))
+    return inode->data.inline_data;
+  if (sector == (block_sector_t) -1)
+    return hole_sector;
+  return bc_pin (sector);
+}
+
+/* Releases sector holding byte OFFSET of INODE pinned by inode_pin_at(),
+   which returned DATA. */
+void
+inode_unpin_at (struct inode *inode, off_t offset, const void *data)
+{
+  off_t inode_left;
+
+  if (data != hole_sector && data != inode->data.inline_data)
+    bc_unpin (lookup_sector (inode, offset, &inode_left), false);
+}
+
+/* Detect sequential access of INODE and request read-ahead of sectors
+   following a read of SIZE bytes at OFFSET.
+   Read-ahead window doubles on every sequential read up to
+   READ_AHEAD_MAX sectors, and is closed on non-sequential read. Sectors
+   already requested are not requested again. */
+static void
+inode_read_ahead (struct inode *inode, off_t offset, off_t size)
+{
+  if (offset != inode->ra_next) {
+    inode->ra_window = 0;
+    inode->ra_end = 0;
+  }
+  else if (inode->ra_window == 0)
+    inode->ra_window = READ_AHEAD_MIN;
+  else if (inode->ra_window < READ_AHEAD_MAX)
+    inode->ra_window *= 2;
+  inode->ra_next = offset + size;
+
+  if (inode->ra_window == 0)
+    return;
+
+  rwlock_acquire_read (&inode->rwlock);
+  off_t length = inode_length (inode);
+  off_t start = DIV_ROUND_UP (offset + size, BLOCK_SECTOR_SIZE);
+  off_t end = start + inode->ra_window;
+  if (start < inode->ra_end)
+    start = inode->ra_end;
+  for (; start < end && start * BLOCK_SECTOR_SIZE < length; start++)
+    {
+      block_sector_t sector = byte_to_sector (inode,
+                                              start * BLOCK_SECTOR_SIZE);
+      if (sector != (block_sector_t) -1)
+        bc_read_ahead (sector);
+    }
+  rwlock_release (&inode->rwlock);
+  inode->ra_end = start;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -306,35 +728,60 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   off_t bytes_written = 0;
   struct inode_disk *disk_inode = &inode->data;
 
+  /* Extend file if needed, and allocate sectors for holes being written.
+     Writing stops at a hole left if disk is full. */
+  rwlock_acquire_write (&inode->rwlock);
   if (inode->deny_write_cnt)
-    return 0;
-
-  /* Extend file if needed */
-  lock_acquire(&inode->extend_lock);
-  off_t old_length = disk_inode->length;
+    {
+      rwlock_release (&inode->rwlock);
+      return 0;
+    }
   off_t write_end = offset + size;
 
-  if (write_end > old_length) {
-    inode_extend_file(disk_inode, write_end);
-  }
+  if (is_inline_inode (disk_inode) && write_end > (off_t) INLINE_BYTES
+      && !inline_migrate (inode))
+    {
+      rwlock_release (&inode->rwlock);
+      return 0;
+    }
+  if (write_end > disk_inode->length)
+    disk_inode->length = write_end;
+  if (!is_inline_inode (disk_inode))
+    inode_allocate (inode, offset, size);
   bc_write(inode->sector, disk_inode, BLOCK_SECTOR_SIZE, 0);
-  lock_release(&inode->extend_lock);
+  rwlock_release (&inode->rwlock);
 
   /* Write buffer to disk. */
   while (size > 0) 
     {
+      /* Inline data is copied under INODE's lock, through a bounce
+         buffer since BUFFER may page fault. */
+      if (is_inline_inode (disk_inode))
+        {
+          uint8_t bounce[INLINE_CHUNK];
+          int chunk_size = size < INLINE_CHUNK ? size : INLINE_CHUNK;
+          memcpy (bounce, buffer + bytes_written, chunk_size);
+          if (inline_write (inode, bounce, chunk_size, offset))
+            {
+              size -= chunk_size;
+              offset += chunk_size;
+              bytes_written += chunk_size;
+              continue;
+            }
+        }
+
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (disk_inode, offset);
+      off_t inode_left;
+      block_sector_t sector_idx = lookup_sector (inode, offset, &inode_left);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      if (chunk_size <= 0 || sector_idx == (block_sector_t) -1)
         break;
       bc_write(sector_idx, buffer + bytes_written, chunk_size, sector_ofs);
 
@@ -352,8 +799,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -362,162 +811,278 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release (&inode->rwlock);
 }
 
-/* Update new sector number in disk_inode.
-   Iterate inode's block table to fin empty element.
-   First iterate direct block table, then indirect block table, and then
-   double indirect block table.
-   If empty element is found, register new_sector to it.
-   Return whether register new_sector is success. */
-static bool
-register_sector (struct inode_disk *disk_inode, block_sector_t new_sector)
+/* Locks directory entries of directory INODE, for modifying them if
+   WRITE is true, otherwise for reading only. A thread may hold locks of
+   two directories only in parent-to-child order. */
+void
+inode_lock_dir (struct inode *inode, bool write)
 {
-  block_sector_t *update = NULL;
-  block_sector_t ind1, ind2;
-  struct inode_indirect_block *indirect = NULL;
-  struct inode_indirect_block *double_indirect = NULL;
-  size_t i, j;
+  if (write)
+    rwlock_acquire_write (&inode->dir_lock);
+  else
+    rwlock_acquire_read (&inode->dir_lock);
+}
 
-  /* Iterate to find empty table. */
-  /* Direct access. */
-  for (i = 0; i < DIRECT_BLOCK_ENTRIES; i++) {
-    if (disk_inode->direct_block[i] == 0) {
-      update = &disk_inode->direct_block[i];
-      goto update;
+/* Unlocks directory entries of INODE locked by inode_lock_dir(). */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  rwlock_release (&inode->dir_lock);
+}
+
+/* Writes back INODE's dirty sectors in buffer cache to disk: its data
+   blocks, index blocks and on-disk inode. Other files' sectors are left to
+   write-behind. */
+void
+inode_flush (struct inode *inode)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t i, cnt;
+
+  rwlock_acquire_read (&inode->rwlock);
+  cnt = bytes_to_sectors (disk_inode->length);
+  if (is_inline_inode (disk_inode))
+    {
+      bc_flush_sector (inode->sector);
+      rwlock_release (&inode->rwlock);
+      return;
+    }
+  if (is_extent_inode (disk_inode))
+    {
+      extent_flush (disk_inode);
+      bc_flush_sector (inode->sector);
+      rwlock_release (&inode->rwlock);
+      return;
     }
-  }
 
-  /* Indirect access. */
-  indirect = malloc(sizeof *indirect);
-  if (indirect == NULL) return false;
-
-  ind1 = disk_inode->indirect_block;
-  /* If this is first time of accessing indirect table, make it. */
-  if (ind1 == 0) {
-    block_sector_t new_indirect;
-    if (free_map_allocate(1, &new_indirect)) {
-      static char zeros[BLOCK_SECTOR_SIZE];
-      bc_write (new_indirect, zeros, BLOCK_SECTOR_SIZE, 0);
-      disk_inode->indirect_block = new_indirect;
-      ind1 = new_indirect;
-    }
-    else {
-      free(indirect);
-      return false;
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t sector = byte_to_sector (inode, i * BLOCK_SECTOR_SIZE);
+      if (sector != (block_sector_t) -1)
+        bc_flush_sector (sector);
     }
-  }
-  /* Iterate indirect table to find empty element. */
-  bc_read(ind1, indirect, BLOCK_SECTOR_SIZE, 0);
-  for (i = 0; i < INDIRECT_BLOCK_ENTRIES; i++) {
-    if (indirect->table[i] == 0) {
-      update = &indirect->table[i];
-      goto update;
+
+  if (disk_inode->indirect_block != 0)
+    bc_flush_sector (disk_inode->indirect_block);
+  if (disk_inode->double_indirect_block != 0)
+    {
+      block_sector_t dib = disk_inode->double_indirect_block;
+      struct inode_indirect_block *indirect = bc_pin (dib);
+      for (i = 0; i < INDIRECT_BLOCK_ENTRIES; i++)
+        if (indirect->table[i] != 0)
+          bc_flush_sector (indirect->table[i]);
+      bc_unpin (dib, false);
+      bc_flush_sector (dib);
     }
-  }
 
-  /* Double indirect access. */
-  double_indirect = malloc(sizeof *indirect);
-  if (double_indirect == NULL) {
-    free(indirect);
+  bc_flush_sector (inode->sector);
+  rwlock_release (&inode->rwlock);
+}
+
+/* Allocate a new index block filled with zeros and store its sector
+   number in *SECTORP. Return false if disk is full. */
+static bool
+alloc_index_block (block_sector_t *sectorp)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  block_sector_t new_indirect;
+
+  if (!free_map_allocate (1, &new_indirect))
     return false;
-  }
+  bc_write (new_indirect, zeros, BLOCK_SECTOR_SIZE, 0);
+  *sectorp = new_indirect;
+  return true;
+}
 
-  ind1 = disk_inode->double_indirect_block;
-  /* If this is first time of accessing double indirect table, make it. */
-  if (ind1 == 0) {
-    block_sector_t new_indirect;
-    if (free_map_allocate(1, &new_indirect)) {
-      static char zeros[BLOCK_SECTOR_SIZE];
-      bc_write (new_indirect, zeros, BLOCK_SECTOR_SIZE, 0);
-      disk_inode->double_indirect_block = new_indirect;
-      ind1 = new_indirect;
-    }
-    else {
-      free(indirect);
-      return false;
-    }
-  }
+/* Cursor for appending sectors to an inode's block table. Index table
+   being filled stays pinned in the buffer cache until the cursor moves to
+   another table, so it is modified in place and written once per
+   extension rather than once per sector. */
+struct append_cursor
+  {
+    int table_no;                       /* -1: none, 0: indirect table,
+                                           1 + i: table i of double
+                                           indirect table. */
+    block_sector_t sector;              /* Sector of pinned table. */
+    struct inode_indirect_block *table; /* Pinned table. */
+  };
 
-  /* Iterate double indirect table to find empty element. */
-  bc_read(ind1, indirect, BLOCK_SECTOR_SIZE, 0);
-  for (i = 0; i < INDIRECT_BLOCK_ENTRIES; i++) {
-    ind2 = indirect->table[i];
-    /* If this is first time of accessing indirect table, make it. */
-    if (ind2 == 0) {
-      block_sector_t new_indirect;
-      if (free_map_allocate(1, &new_indirect)) {
-        static char zeros[BLOCK_SECTOR_SIZE];
-        bc_write (new_indirect, zeros, BLOCK_SECTOR_SIZE, 0);
-        indirect->table[i] = new_indirect;
-        ind2 = new_indirect;
-      }
-      else {
-        free(indirect);
-        return false;
-      }
-    }
+/* Moves cursor C to index table TABLE_NO, whose sector is read from (and
+   allocated in, if it is 0) *SECTORP. Return false if disk is full. */
+static bool
+cursor_seek (struct append_cursor *c, int table_no, block_sector_t *sectorp)
+{
+  if (*sectorp == 0 && !alloc_index_block (sectorp))
+    return false;
+  if (c->table != NULL)
+    bc_unpin (c->sector, true);
+  c->table_no = table_no;
+  c->sector = *sectorp;
+  c->table = bc_pin (c->sector);
+  return true;
+}
 
-    /* Iterate indirect table to fine empty element. */
-    bc_read(ind2, double_indirect, BLOCK_SECTOR_SIZE, 0);
-    for (j = 0; j < INDIRECT_BLOCK_ENTRIES; j++) {
-      if (double_indirect->table[j] == 0) {
-        update = &double_indirect->table[j];
-        goto update;
-      }
-    }
-  }
+/* Returns the block table entry of sector index IDX of DISK_INODE, moving
+   cursor C and allocating index tables as needed. Return a null pointer
+   if IDX is beyond max file size or disk is full. */
+static block_sector_t *
+cursor_entry (struct append_cursor *c, struct inode_disk *disk_inode,
+              size_t idx)
+{
+  /* Direct access. */
+  if (idx < DIRECT_BLOCK_ENTRIES)
+    return &disk_inode->direct_block[idx];
+  idx -= DIRECT_BLOCK_ENTRIES;
 
-  /* Now register new block. */
-  update:
-    ASSERT (update != NULL);
-    *update = new_sector;
-    /* If indirect table was updated, write to disk and free. */
-    if (indirect != NULL) {
-      bc_write(ind1, indirect, BLOCK_SECTOR_SIZE, 0);
-      free(indirect);
+  /* Indirect access. */
+  if (idx < INDIRECT_BLOCK_ENTRIES)
+    {
+      if (c->table_no != 0
+          && !cursor_seek (c, 0, &disk_inode->indirect_block))
+        return NULL;
+      return &c->table->table[idx];
     }
-    /* If double indirect table was updated, write to disk and free. */
-    if (double_indirect != NULL) {
-      bc_write(ind2, double_indirect, BLOCK_SECTOR_SIZE, 0);
-      free(double_indirect);
+  idx -= INDIRECT_BLOCK_ENTRIES;
+
+  /* Double indirect access. Double indirect table is only consulted when
+     cursor moves to its next table. */
+  if (idx >= INDIRECT_BLOCK_ENTRIES * INDIRECT_BLOCK_ENTRIES)
+    return NULL;
+  int table_no = 1 + idx / INDIRECT_BLOCK_ENTRIES;
+  if (c->table_no != table_no)
+    {
+      block_sector_t dib, table_sector;
+      struct inode_indirect_block *dtable;
+      bool success;
+
+      if (disk_inode->double_indirect_block == 0
+          && !alloc_index_block (&disk_inode->double_indirect_block))
+        return NULL;
+      dib = disk_inode->double_indirect_block;
+      dtable = bc_pin (dib);
+      table_sector = dtable->table[table_no - 1];
+      success = cursor_seek (c, table_no, &table_sector);
+      if (success)
+        dtable->table[table_no - 1] = table_sector;
+      bc_unpin (dib, success);
+      if (!success)
+        return NULL;
     }
-    return true;
+  return &c->table->table[idx % INDIRECT_BLOCK_ENTRIES];
 }
 
-/* Extend file length of On-disk inode.
-   Allocate free map, and register it until pos. */
+/* Allocates sectors for the holes of INODE between OFFSET and
+   OFFSET + SIZE, which must be within INODE's length. Each run of holes
+   is allocated in runs of sectors as long as possible, right after the
+   sector before it, or after the inode if there is none, so that file
+   data is contiguous and near its inode. New sectors are cleared in the
+   buffer cache before they are linked in, since inode_write_at() copies
+   its data only after releasing INODE's lock, and a reader or read-ahead
+   must not see a freed sector's old contents meanwhile. They are never
+   read from disk. Return false if disk is full or file is too large. */
 static bool
-inode_extend_file (struct inode_disk *disk_inode, off_t pos)
+inode_allocate (struct inode *inode, off_t offset, off_t size)
 {
-  ASSERT (pos > disk_inode->length);
-  off_t start = (off_t) bytes_to_sectors(disk_inode->length);
-  off_t end = (off_t) bytes_to_sectors(pos);
-  block_sector_t new_sector;
+  static char zeros[BLOCK_SECTOR_SIZE];
+  struct inode_disk *disk_inode = &inode->data;
+  struct append_cursor c = { -1, 0, NULL };
+  size_t idx = offset / BLOCK_SECTOR_SIZE;
+  size_t end = bytes_to_sectors (offset + size);
+  block_sector_t hint = inode->sector + 1;
+  bool changed = false, success = false;
 
-  while (start < end) {
-    if (free_map_allocate (1, &new_sector))
-      {
-        static char zeros[BLOCK_SECTOR_SIZE];
-        bc_write (new_sector, zeros, BLOCK_SECTOR_SIZE, 0);
+  if (idx > 0)
+    {
+      block_sector_t prev = byte_to_sector (inode,
+                                            (idx - 1) * BLOCK_SECTOR_SIZE);
+      if (prev != (block_sector_t) -1)
+        hint = prev + 1;
+    }
 
-        /* Register new sector */
-        if (!register_sector(disk_inode, new_sector)) {
-          return false;
+  while (idx < end)
+    {
+      block_sector_t sector = byte_to_sector (inode, idx * BLOCK_SECTOR_SIZE);
+      block_sector_t first, *entry;
+      size_t cnt, i;
+
+      if (sector != (block_sector_t) -1)
+        {
+          hint = sector + 1;
+          idx++;
+          continue;
         }
-      }
-    /* Return false if free_map_allocate is failed. */
-    else
-      {
-        return false;
-      }
-    start++;
-  }
-  disk_inode->length = pos;
-  return true;
+
+      /* Length of this run of holes. */
+      for (cnt = 1; idx + cnt < end && cnt < EXTEND_RUN_MAX; cnt++)
+        if (byte_to_sector (inode, (idx + cnt) * BLOCK_SECTOR_SIZE)
+            != (block_sector_t) -1)
+          break;
+
+      /* Return false if free_map_allocate_run is failed. */
+      cnt = free_map_allocate_run (cnt, hint, &first);
+      if (cnt == 0)
+        goto done;
+      hint = first + cnt;
+
+      /* Clear new sectors before readers can reach them. */
+      for (i = 0; i < cnt; i++)
+        bc_write (first + i, zeros, BLOCK_SECTOR_SIZE, 0);
+
+      /* Register new sectors */
+      if (is_extent_inode (disk_inode))
+        {
+          if (!extent_insert (disk_inode, idx, first, cnt))
+            {
+              free_map_release (first, cnt);
+              goto done;
+            }
+        }
+      else
+        for (i = 0; i < cnt; i++)
+          {
+            entry = cursor_entry (&c, disk_inode, idx + i);
+            if (entry == NULL)
+              {
+                free_map_release (first + i, cnt - i);
+                if (i > 0)
+                  changed = true;
+                goto done;
+              }
+            *entry = first + i;
+          }
+      changed = true;
+      idx += cnt;
+    }
+  success = true;
+
+ done:
+  if (c.table != NULL)
+    bc_unpin (c.sector, true);
+  if (changed && !is_extent_inode (disk_inode))
+    map_destroy (inode);
+  return success;
+}
+/* Free data blocks listed in index block SECTOR, then the index block
+   itself. Index block is inspected in place in the buffer cache. Zero
+   entries are holes. */
+static void
+free_indirect_sectors (block_sector_t sector)
+{
+  struct inode_indirect_block *indirect = bc_pin(sector);
+  size_t i;
+
+  for (i = 0; i < INDIRECT_BLOCK_ENTRIES; i++)
+    if (indirect->table[i] > 0)
+      free_map_release(indirect->table[i], 1);
+  bc_unpin(sector, false);
+  free_map_release(sector, 1);
 }
 
 /* Free allcated block to On-disk inode.
@@ -526,52 +1091,348 @@ inode_extend_file (struct inode_disk *disk_inode, off_t pos)
 static void
 free_inode_sectors (struct inode_disk *disk_inode)
 {
+  size_t i;
+
+  if (is_inline_inode (disk_inode))
+    return;
+  if (is_extent_inode (disk_inode))
+    {
+      extent_free (disk_inode);
+      return;
+    }
+
   /* Free double indirect blocks if exist. */
   if(disk_inode->double_indirect_block > 0) {
-    int i = 0;
-    struct inode_indirect_block *ind_block1 = malloc(sizeof *ind_block1);
-
-    /* Get double indirect table. */
-    bc_read(disk_inode->double_indirect_block, ind_block1, BLOCK_SECTOR_SIZE, 0);
-    while (ind_block1->table[i] > 0) {
-      int j = 0;
-      struct inode_indirect_block *ind_block2 = malloc(sizeof *ind_block2);
-
-      /* Get indirect table. */
-      bc_read(ind_block1->table[i], ind_block2, BLOCK_SECTOR_SIZE, 0);
-      while (ind_block2->table[j] > 0) {
-        free_map_release(ind_block2->table[j], 1);
-        j++;
-      }
-      free(ind_block2);
-      free_map_release(ind_block1->table[i], 1);
-      i++;
-    }
-    free(ind_block1);
-    free_map_release(disk_inode->double_indirect_block, 1);
+    block_sector_t dib = disk_inode->double_indirect_block;
+    struct inode_indirect_block *ind_block1 = bc_pin(dib);
+
+    for (i = 0; i < INDIRECT_BLOCK_ENTRIES; i++)
+      if (ind_block1->table[i] > 0)
+        free_indirect_sectors(ind_block1->table[i]);
+    bc_unpin(dib, false);
+    free_map_release(dib, 1);
   }
 
   /* Free indirect blocks if exist. */
-  if(disk_inode->indirect_block > 0) {
-    int i = 0;
-    struct inode_indirect_block *ind_block1 = malloc(sizeof *ind_block1);
-
-    /* Get indirect table. */
-    bc_read(disk_inode->double_indirect_block, ind_block1, BLOCK_SECTOR_SIZE, 0);
-    while (ind_block1->table[i] > 0) {
-      free_map_release(ind_block1->table[i], 1);
-      i++;
-    }
-    free(ind_block1);
-    free_map_release(disk_inode->indirect_block, 1);
-  }
+  if(disk_inode->indirect_block > 0)
+    free_indirect_sectors(disk_inode->indirect_block);
 
   /* Free direct blocks */
-  int i = 0;
-  while(disk_inode->direct_block[i] > 0) {
-    free_map_release(disk_inode->direct_block[i],1);
-    i++;
-  }
+  for (i = 0; i < DIRECT_BLOCK_ENTRIES; i++)
+    if (disk_inode->direct_block[i] > 0)
+      free_map_release(disk_inode->direct_block[i], 1);
+}
+
+/* Extent-based inodes. */
+
+/* Returns the index of the last of the CNT extents in E, which are
+   sorted by file sector, that starts at or before file sector FS, or
+   -1 if there is none. */
+static int
+extent_search (const struct extent *e, uint32_t cnt, uint32_t fs)
+{
+  uint32_t lo = 0, hi = cnt;
+
+  while (lo < hi)
+    {
+      uint32_t mid = (lo + hi) / 2;
+      if (e[mid].file_sector <= fs)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return (int) lo - 1;
+}
+
+/* Returns the disk sector holding sector index FILE_SECTOR of
+   extent-based DISK_INODE, or -1 if no extent covers it. Extents in
+   inode are binary searched first, then extent blocks in order. Since
+   extents are sorted, search stops at first extent past FILE_SECTOR,
+   and only extent blocks before it are pinned. */
+static block_sector_t
+extent_to_sector (const struct inode_disk *disk_inode, off_t file_sector)
+{
+  uint32_t fs = file_sector;
+  uint32_t cnt = disk_inode->extent_cnt < INODE_EXTENTS
+                 ? disk_inode->extent_cnt : INODE_EXTENTS;
+  int i = extent_search (disk_inode->extents, cnt, fs);
+  block_sector_t next;
+
+  if (i >= 0 && fs - disk_inode->extents[i].file_sector
+                < disk_inode->extents[i].cnt)
+    return disk_inode->extents[i].start
+           + (fs - disk_inode->extents[i].file_sector);
+  if ((uint32_t) (i + 1) < cnt)
+    return -1;
+
+  for (next = disk_inode->extent_head; next != 0; )
+    {
+      block_sector_t sector = next;
+      struct extent_block *eb = bc_pin (sector);
+      block_sector_t result = -1;
+      bool done;
+
+      i = extent_search (eb->extents, eb->cnt, fs);
+      if (i >= 0 && fs - eb->extents[i].file_sector < eb->extents[i].cnt)
+        result = eb->extents[i].start + (fs - eb->extents[i].file_sector);
+      done = result != (block_sector_t) -1 || (uint32_t) (i + 1) < eb->cnt;
+      next = eb->next;
+      bc_unpin (sector, false);
+      if (done)
+        return result;
+    }
+  return -1;
+}
+
+/* Returns the number of extents of DISK_INODE that start at or before
+   file sector FS, which is where an extent starting at FS belongs. */
+static uint32_t
+extent_pos (const struct inode_disk *disk_inode, uint32_t fs)
+{
+  uint32_t base = disk_inode->extent_cnt < INODE_EXTENTS
+                  ? disk_inode->extent_cnt : INODE_EXTENTS;
+  uint32_t pos = extent_search (disk_inode->extents, base, fs) + 1;
+  block_sector_t next;
+
+  if (pos < base)
+    return pos;
+  for (next = disk_inode->extent_head; next != 0; )
+    {
+      block_sector_t sector = next;
+      struct extent_block *eb = bc_pin (sector);
+      uint32_t cnt = eb->cnt;
+
+      pos = extent_search (eb->extents, cnt, fs) + 1;
+      next = eb->next;
+      bc_unpin (sector, false);
+      if (pos < cnt)
+        return base + pos;
+      base += cnt;
+    }
+  return base;
+}
+
+/* Returns extent number IDX of DISK_INODE. If it lives in an extent
+   block, the block is pinned and its sector stored in *SECTORP, which
+   caller must unpin; otherwise *SECTORP is set to 0. Extent blocks
+   other than the last are always full, so the last one is reached
+   directly. */
+static struct extent *
+extent_ref (struct inode_disk *disk_inode, uint32_t idx,
+            block_sector_t *sectorp)
+{
+  struct extent_block *eb;
+  block_sector_t sector;
+  uint32_t block, block_cnt;
+
+  ASSERT (idx < disk_inode->extent_cnt);
+  *sectorp = 0;
+  if (idx < INODE_EXTENTS)
+    return &disk_inode->extents[idx];
+
+  idx -= INODE_EXTENTS;
+  block = idx / EXTENT_BLOCK_ENTRIES;
+  block_cnt = DIV_ROUND_UP (disk_inode->extent_cnt - INODE_EXTENTS,
+                            EXTENT_BLOCK_ENTRIES);
+  if (block == block_cnt - 1)
+    sector = disk_inode->extent_tail;
+  else
+    for (sector = disk_inode->extent_head; block > 0; block--)
+      {
+        eb = bc_pin (sector);
+        block_sector_t next = eb->next;
+        bc_unpin (sector, false);
+        sector = next;
+      }
+  eb = bc_pin (sector);
+  *sectorp = sector;
+  return &eb->extents[idx % EXTENT_BLOCK_ENTRIES];
+}
+
+/* Inserts run of CNT sectors at START, holding file's sector FILE_SECTOR
+   and on, into DISK_INODE in file order. FILE_SECTOR must be in a hole.
+   Run is merged into the extent before or after it if it continues that
+   extent both in file and on disk, which is the common case of a file
+   growing at its end. Otherwise later extents move up by one, the last
+   of each full extent block to the front of the next. Return false if a
+   new extent block is needed but disk is full. */
+static bool
+extent_insert (struct inode_disk *disk_inode, uint32_t file_sector,
+               block_sector_t start, uint32_t cnt)
+{
+  struct extent carry = { file_sector, start, cnt };
+  uint32_t pos = extent_pos (disk_inode, file_sector);
+  struct extent_block *eb;
+  block_sector_t sector, next;
+  struct extent *e;
+  uint32_t base, n;
+  bool merge;
+
+  if (pos > 0)
+    {
+      e = extent_ref (disk_inode, pos - 1, &sector);
+      merge = (e->file_sector + e->cnt == file_sector
+               && e->start + e->cnt == start);
+      if (merge)
+        e->cnt += cnt;
+      if (sector != 0)
+        bc_unpin (sector, merge);
+      if (merge)
+        return true;
+    }
+  if (pos < disk_inode->extent_cnt)
+    {
+      e = extent_ref (disk_inode, pos, &sector);
+      merge = (file_sector + cnt == e->file_sector
+               && start + cnt == e->start);
+      if (merge)
+        {
+          e->file_sector = file_sector;
+          e->start = start;
+          e->cnt += cnt;
+        }
+      if (sector != 0)
+        bc_unpin (sector, merge);
+      if (merge)
+        return true;
+    }
+
+  /* Make room for one more extent at the end, chaining a new extent
+     block if the inode and all extent blocks are full. */
+  if (disk_inode->extent_cnt >= INODE_EXTENTS
+      && (disk_inode->extent_cnt - INODE_EXTENTS) % EXTENT_BLOCK_ENTRIES == 0)
+    {
+      block_sector_t new_block;
+      if (!alloc_index_block (&new_block))
+        return false;
+      if (disk_inode->extent_tail == 0)
+        disk_inode->extent_head = new_block;
+      else
+        {
+          eb = bc_pin (disk_inode->extent_tail);
+          eb->next = new_block;
+          bc_unpin (disk_inode->extent_tail, true);
+        }
+      disk_inode->extent_tail = new_block;
+    }
+  disk_inode->extent_cnt++;
+
+  /* Insert into inode. */
+  if (pos < INODE_EXTENTS)
+    {
+      e = disk_inode->extents;
+      n = disk_inode->extent_cnt - 1;
+      if (n < INODE_EXTENTS)
+        {
+          memmove (e + pos + 1, e + pos, (n - pos) * sizeof *e);
+          e[pos] = carry;
+          return true;
+        }
+      struct extent last = e[INODE_EXTENTS - 1];
+      memmove (e + pos + 1, e + pos, (INODE_EXTENTS - 1 - pos) * sizeof *e);
+      e[pos] = carry;
+      carry = last;
+      pos = INODE_EXTENTS;
+    }
+
+  /* Insert into extent blocks. */
+  base = INODE_EXTENTS;
+  for (sector = disk_inode->extent_head; sector != 0; sector = next)
+    {
+      bool dirty = false;
+      eb = bc_pin (sector);
+      if (pos < base + EXTENT_BLOCK_ENTRIES)
+        {
+          uint32_t i = pos - base;
+          e = eb->extents;
+          n = eb->cnt;
+          dirty = true;
+          if (n < EXTENT_BLOCK_ENTRIES)
+            {
+              memmove (e + i + 1, e + i, (n - i) * sizeof *e);
+              e[i] = carry;
+              eb->cnt++;
+              bc_unpin (sector, true);
+              return true;
+            }
+          struct extent last = e[EXTENT_BLOCK_ENTRIES - 1];
+          memmove (e + i + 1, e + i,
+                   (EXTENT_BLOCK_ENTRIES - 1 - i) * sizeof *e);
+          e[i] = carry;
+          carry = last;
+          pos = base + EXTENT_BLOCK_ENTRIES;
+        }
+      next = eb->next;
+      base += EXTENT_BLOCK_ENTRIES;
+      bc_unpin (sector, dirty);
+    }
+  NOT_REACHED ();
+}
+
+/* Writes back data sectors and extent blocks of extent-based DISK_INODE,
+   one run at a time. */
+static void
+extent_flush (struct inode_disk *disk_inode)
+{
+  uint32_t i;
+  block_sector_t next;
+
+  for (i = 0; i < disk_inode->extent_cnt && i < INODE_EXTENTS; i++)
+    bc_flush_range (disk_inode->extents[i].start, disk_inode->extents[i].cnt);
+  for (next = disk_inode->extent_head; next != 0; )
+    {
+      block_sector_t sector = next;
+      struct extent_block *eb = bc_pin (sector);
+      for (i = 0; i < eb->cnt; i++)
+        bc_flush_range (eb->extents[i].start, eb->extents[i].cnt);
+      next = eb->next;
+      bc_unpin (sector, false);
+      bc_flush_sector (sector);
+    }
+}
+
+/* Frees data sectors and extent blocks of extent-based DISK_INODE, one
+   run at a time. */
+static void
+extent_free (struct inode_disk *disk_inode)
+{
+  uint32_t i;
+  block_sector_t next;
+
+  for (i = 0; i < disk_inode->extent_cnt && i < INODE_EXTENTS; i++)
+    free_map_release (disk_inode->extents[i].start,
+                      disk_inode->extents[i].cnt);
+  for (next = disk_inode->extent_head; next != 0; )
+    {
+      block_sector_t sector = next;
+      struct extent_block *eb = bc_pin (sector);
+      for (i = 0; i < eb->cnt; i++)
+        free_map_release (eb->extents[i].start, eb->extents[i].cnt);
+      next = eb->next;
+      bc_unpin (sector, false);
+      free_map_release (sector, 1);
+    }
+}
+
+/* Returns true if the on-disk inode at SECTOR is extent-based. Used at
+   mount time to make new inodes follow format of file system. */
+bool
+inode_probe_extents (block_sector_t sector)
+{
+  unsigned magic;
+  bc_read (sector, &magic, sizeof magic, offsetof (struct inode_disk, magic));
+  return magic == EXTENT_MAGIC;
+}
+
+/* Returns true if the inode at SECTOR is a directory. Reads its type
+   through the buffer cache, without opening it. */
+bool
+inode_probe_dir (block_sector_t sector)
+{
+  uint32_t isfile;
+  bc_read (sector, &isfile, sizeof isfile,
+           offsetof (struct inode_disk, isfile));
+  return isfile == DIRECTORY;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -13,16 +13,27 @@ struct bitmap;
 
 struct inode;
 
+/* If true, new inodes are extent-based. */
+extern bool inode_extents;
+
 void inode_init (void);
+bool inode_probe_extents (block_sector_t);
+bool inode_probe_dir (block_sector_t);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_is_removed (const struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+const void *inode_pin_at (struct inode *, off_t offset);
+void inode_unpin_at (struct inode *, off_t offset, const void *);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_flush (struct inode *);
+void inode_lock_dir (struct inode *, bool write);
+void inode_unlock_dir (struct inode *);
 
 off_t inode_length (const struct inode *);
 bool is_inode_file (struct inode *);
@@ -0,0 +1,19 @@
+#ifndef __LIB_CACHE_STAT_H
+#define __LIB_CACHE_STAT_H
+
+/* Buffer cache statistics, as returned by the cachestat() system
+   call.  Counters are cumulative since boot. */
+struct cache_stat
+  {
+    unsigned long long hit_cnt;         /* Accesses found in cache. */
+    unsigned long long miss_cnt;        /* Accesses not found in cache. */
+    unsigned long long evict_cnt;       /* Entries evicted. */
+    unsigned long long unused_evict_cnt;/* Evicted without being accessed. */
+    unsigned long long write_back_cnt;  /* Dirty sectors written to disk. */
+    unsigned long long write_io_cnt;    /* Disk writes for write-backs. */
+    unsigned long long rbw_cnt;         /* Reads before partial writes. */
+    unsigned long long read_ahead_cnt;  /* Sectors loaded by read-ahead. */
+    unsigned entry_cnt;                 /* Entries currently in memory. */
+  };
+
+#endif /* lib/cache-stat.h */
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -28,6 +29,8 @@ struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    size_t false_hint;  /* No bit below this index is false.
+                           Updated with interrupts off. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -68,7 +71,55 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the index of the lowest set bit in ELEM, which must
+   not be zero.  Compiles to a single BSF instruction. */
+static inline size_t
+first_set (elem_type elem)
+{
+  return __builtin_ctzl (elem);
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's size if there is none.  Whole elements
+   with no such bit are skipped at once. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, bool value)
+{
+  size_t idx = elem_idx (start);
+  size_t cnt = elem_cnt (b->bit_cnt);
+  elem_type elem;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  /* Bits below START in the first element are masked off. */
+  elem = value ? b->bits[idx] : ~b->bits[idx];
+  elem &= (elem_type) -1 << (start % ELEM_BITS);
+  while (elem == 0)
+    {
+      if (++idx >= cnt)
+        return b->bit_cnt;
+      elem = value ? b->bits[idx] : ~b->bits[idx];
+    }
+
+  start = idx * ELEM_BITS + first_set (elem);
+  return start < b->bit_cnt ? start : b->bit_cnt;
+}
 
+/* Lowers B's false_hint to BIT_IDX, which may have just become
+   false.  Bits may be freed without any lock held (palloc does so
+   even from thread_schedule_tail()), so the test and the store must
+   not be interleaved with another update of the hint. */
+static inline void
+lower_hint (struct bitmap *b, size_t bit_idx)
+{
+  enum intr_level old_level = intr_disable ();
+  if (bit_idx < b->false_hint)
+    b->false_hint = bit_idx;
+  intr_set_level (old_level);
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -82,6 +133,7 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
+      b->false_hint = 0;
       b->bits = malloc (byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
@@ -104,6 +156,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
+  b->false_hint = 0;
   b->bits = (elem_type *) (b + 1);
   bitmap_set_all (b, false);
   return b;
@@ -177,6 +230,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  lower_hint (b, bit_idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -192,6 +246,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  lower_hint (b, bit_idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -251,16 +306,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return next_bit (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -292,20 +342,32 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Runs are found an element at a time: the scan jumps to the
+   next bit set to VALUE, then to the next one set to !VALUE,
+   which ends the run.  Scanning for false starts no lower than
+   B's false_hint, so a long fully used prefix is skipped. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 0)
+    return start;
+  if (!value && start < b->false_hint)
+    start = b->false_hint;
+  while (start < b->bit_cnt && cnt <= b->bit_cnt - start)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t end;
+
+      start = next_bit (b, start, value);
+      if (start >= b->bit_cnt || cnt > b->bit_cnt - start)
+        break;
+      end = next_bit (b, start, !value);
+      if (end - start >= cnt)
+        return start;
+      start = end;
     }
   return BITMAP_ERROR;
 }
@@ -320,7 +382,19 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t idx = bitmap_scan (b, start, cnt, value);
+  size_t idx;
+
+  /* Advance hint to the first false bit, since we can modify B.
+     Interrupts are off so that no bit below the new hint can be
+     freed between finding it and storing it. */
+  if (!value && start <= b->false_hint)
+    {
+      enum intr_level old_level = intr_disable ();
+      b->false_hint = next_bit (b, b->false_hint, false);
+      intr_set_level (old_level);
+    }
+
+  idx = bitmap_scan (b, start, cnt, value);
   if (idx != BITMAP_ERROR) 
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
@@ -347,6 +421,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      b->false_hint = 0;
     }
   return success;
 }
@@ -359,6 +434,22 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes SIZE bytes of B starting at byte offset OFS to the same
+   offset of FILE, as much as lies within B.  Return true if
+   successful, false otherwise. */
+bool
+bitmap_write_partial (const struct bitmap *b, struct file *file,
+                      size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+  if (ofs >= file_size)
+    return true;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return (file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+          == (off_t) size);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
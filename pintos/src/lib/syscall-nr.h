@@ -28,7 +28,15 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FSYNC,                  /* Writes back a file's dirty data. */
+    SYS_CACHESTAT,              /* Reads buffer cache statistics. */
+    SYS_GETDENTS,               /* Reads many directory entries. */
+    SYS_OPENAT,                 /* Opens a file relative to a directory. */
+    SYS_MKDIRAT,                /* Creates a directory relative to one. */
+    SYS_UNLINKAT                /* Deletes a file relative to a directory. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -182,3 +182,39 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+bool
+cachestat (struct cache_stat *st)
+{
+  return syscall1 (SYS_CACHESTAT, st);
+}
+
+int
+getdents (int fd, struct dirent *ents, unsigned cnt)
+{
+  return syscall3 (SYS_GETDENTS, fd, ents, cnt);
+}
+
+int
+openat (int dirfd, const char *file)
+{
+  return syscall2 (SYS_OPENAT, dirfd, file);
+}
+
+bool
+mkdirat (int dirfd, const char *dir)
+{
+  return syscall2 (SYS_MKDIRAT, dirfd, dir);
+}
+
+bool
+unlinkat (int dirfd, const char *file)
+{
+  return syscall2 (SYS_UNLINKAT, dirfd, file);
+}
@@ -2,6 +2,8 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <cache-stat.h>
+#include <dirent.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -45,4 +47,12 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool fsync (int fd);
+bool cachestat (struct cache_stat *);
+int getdents (int fd, struct dirent *, unsigned cnt);
+int openat (int dirfd, const char *file);
+bool mkdirat (int dirfd, const char *dir);
+bool unlinkat (int dirfd, const char *file);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,41 @@
+/* Writes a small file and reads it back twice, checking with
+   cachestat() that the second read is served from the buffer
+   cache. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1024];
+
+void
+test_main (void) 
+{
+  struct cache_stat before, after;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("cached", sizeof buf), "create \"cached\"");
+  CHECK ((fd = open ("cached")) > 1, "open \"cached\"");
+  CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf,
+         "write \"cached\"");
+
+  seek (fd, 0);
+  CHECK (read (fd, buf, sizeof buf) == (int) sizeof buf,
+         "read \"cached\"");
+  CHECK (cachestat (&before), "cachestat");
+
+  seek (fd, 0);
+  CHECK (read (fd, buf, sizeof buf) == (int) sizeof buf,
+         "read \"cached\" again");
+  CHECK (cachestat (&after), "cachestat");
+
+  if (after.hit_cnt <= before.hit_cnt)
+    fail ("hit count did not increase on re-read");
+  if (after.miss_cnt < before.miss_cnt)
+    fail ("miss count decreased");
+  msg ("close \"cached\"");
+  close (fd);
+}
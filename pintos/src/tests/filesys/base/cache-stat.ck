@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-stat) begin
+(cache-stat) create "cached"
+(cache-stat) open "cached"
+(cache-stat) write "cached"
+(cache-stat) read "cached"
+(cache-stat) cachestat
+(cache-stat) read "cached" again
+(cache-stat) cachestat
+(cache-stat) close "cached"
+(cache-stat) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({'dir' => {'a' => [''], 'b' => [''], 'c' => [''],
+                          'sub' => {}}});
+pass;
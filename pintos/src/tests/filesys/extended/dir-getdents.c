@@ -0,0 +1,54 @@
+/* Reads a directory with getdents(), two entries at a time, and
+   checks each entry's name, type, and inode number. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const char *names[] = {"a", "b", "c", "sub"};
+  struct dirent ents[2];
+  int dir_fd, file_fd, n, i;
+  int cnt = 0;
+
+  CHECK (mkdir ("dir"), "mkdir \"dir\"");
+  CHECK (create ("dir/a", 0), "create \"dir/a\"");
+  CHECK (create ("dir/b", 0), "create \"dir/b\"");
+  CHECK (create ("dir/c", 0), "create \"dir/c\"");
+  CHECK (mkdir ("dir/sub"), "mkdir \"dir/sub\"");
+  CHECK ((dir_fd = open ("dir")) > 1, "open \"dir\"");
+
+  while ((n = getdents (dir_fd, ents, 2)) > 0)
+    for (i = 0; i < n; i++)
+      {
+        char path[32];
+        int fd;
+
+        if (cnt >= 4)
+          fail ("too many entries");
+        if (strcmp (ents[i].name, names[cnt]))
+          fail ("entry %d is \"%s\", expected \"%s\"",
+                cnt, ents[i].name, names[cnt]);
+        if (ents[i].isdir != !strcmp (names[cnt], "sub"))
+          fail ("\"%s\" has wrong type", ents[i].name);
+        snprintf (path, sizeof path, "dir/%s", ents[i].name);
+        CHECK ((fd = open (path)) > 1, "open \"%s\"", path);
+        if (ents[i].inumber != inumber (fd))
+          fail ("\"%s\" has wrong inumber", ents[i].name);
+        close (fd);
+        msg ("getdents: %s %s", ents[i].name,
+             ents[i].isdir ? "directory" : "file");
+        cnt++;
+      }
+  CHECK (n == 0, "getdents at end of directory returns 0");
+  if (cnt != 4)
+    fail ("read %d entries, expected 4", cnt);
+
+  CHECK ((file_fd = open ("dir/a")) > 1, "open \"dir/a\"");
+  CHECK (getdents (file_fd, ents, 2) == -1,
+         "getdents on file (must return -1)");
+}
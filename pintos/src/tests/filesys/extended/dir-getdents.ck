@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "dir"
+(dir-getdents) create "dir/a"
+(dir-getdents) create "dir/b"
+(dir-getdents) create "dir/c"
+(dir-getdents) mkdir "dir/sub"
+(dir-getdents) open "dir"
+(dir-getdents) open "dir/a"
+(dir-getdents) getdents: a file
+(dir-getdents) open "dir/b"
+(dir-getdents) getdents: b file
+(dir-getdents) open "dir/c"
+(dir-getdents) getdents: c file
+(dir-getdents) open "dir/sub"
+(dir-getdents) getdents: sub directory
+(dir-getdents) getdents at end of directory returns 0
+(dir-getdents) open "dir/a"
+(dir-getdents) getdents on file (must return -1)
+(dir-getdents) end
+pass;
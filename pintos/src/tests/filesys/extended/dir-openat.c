@@ -0,0 +1,43 @@
+/* Tests openat(), mkdirat(), and unlinkat() relative to a
+   directory fd, and that absolute paths ignore the fd. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int dir_fd, fd, fd2, file_fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("a/b"), "mkdir \"a/b\"");
+  CHECK ((dir_fd = open ("a/b")) > 1, "open \"a/b\"");
+
+  CHECK (mkdirat (dir_fd, "c"), "mkdirat \"c\"");
+  CHECK (!mkdirat (dir_fd, "missing/x"),
+         "mkdirat \"missing/x\" (must return false)");
+  CHECK ((fd = openat (dir_fd, "c")) > 1, "openat \"c\"");
+  CHECK (isdir (fd), "isdir \"c\"");
+  close (fd);
+
+  CHECK (create ("a/b/f", 0), "create \"a/b/f\"");
+  CHECK ((fd = openat (dir_fd, "f")) > 1, "openat \"f\"");
+  CHECK ((fd2 = open ("a/b/f")) > 1, "open \"a/b/f\"");
+  CHECK (inumber (fd) == inumber (fd2), "same inumber");
+  close (fd);
+  close (fd2);
+
+  CHECK ((fd = openat (dir_fd, "/a")) > 1, "openat \"/a\"");
+  CHECK (inumber (fd) != inumber (dir_fd), "absolute path ignores dirfd");
+  close (fd);
+
+  CHECK (unlinkat (dir_fd, "f"), "unlinkat \"f\"");
+  CHECK (open ("a/b/f") == -1, "open \"a/b/f\" (must return -1)");
+
+  CHECK (create ("a/g", 0), "create \"a/g\"");
+  CHECK ((file_fd = open ("a/g")) > 1, "open \"a/g\"");
+  CHECK (openat (file_fd, "c") == -1, "openat on file (must return -1)");
+  CHECK (!unlinkat (file_fd, "g"), "unlinkat on file (must return false)");
+  CHECK (remove ("a/g"), "remove \"a/g\"");
+}
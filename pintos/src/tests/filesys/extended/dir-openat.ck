@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-openat) begin
+(dir-openat) mkdir "a"
+(dir-openat) mkdir "a/b"
+(dir-openat) open "a/b"
+(dir-openat) mkdirat "c"
+(dir-openat) mkdirat "missing/x" (must return false)
+(dir-openat) openat "c"
+(dir-openat) isdir "c"
+(dir-openat) create "a/b/f"
+(dir-openat) openat "f"
+(dir-openat) open "a/b/f"
+(dir-openat) same inumber
+(dir-openat) openat "/a"
+(dir-openat) absolute path ignores dirfd
+(dir-openat) unlinkat "f"
+(dir-openat) open "a/b/f" (must return -1)
+(dir-openat) create "a/g"
+(dir-openat) open "a/g"
+(dir-openat) openat on file (must return -1)
+(dir-openat) unlinkat on file (must return false)
+(dir-openat) remove "a/g"
+(dir-openat) end
+EOF
+pass;
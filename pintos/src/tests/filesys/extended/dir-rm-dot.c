@@ -0,0 +1,24 @@
+/* Tries to remove a directory through paths ending in "." and
+   "..", which must fail and leave the directories in place. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("a/b"), "mkdir \"a/b\"");
+  CHECK (!remove ("a/."), "remove \"a/.\" (must fail)");
+  CHECK (!remove ("a/b/.."), "remove \"a/b/..\" (must fail)");
+  CHECK (!remove ("a/.."), "remove \"a/..\" (must fail)");
+  CHECK (!remove ("/."), "remove \"/.\" (must fail)");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (!unlinkat (fd, "./."), "unlinkat \"./.\" (must fail)");
+  CHECK (!unlinkat (fd, "b/.."), "unlinkat \"b/..\" (must fail)");
+  close (fd);
+  CHECK (create ("a/b/c", 0), "create \"a/b/c\"");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-rm-dot) begin
+(dir-rm-dot) mkdir "a"
+(dir-rm-dot) mkdir "a/b"
+(dir-rm-dot) remove "a/." (must fail)
+(dir-rm-dot) remove "a/b/.." (must fail)
+(dir-rm-dot) remove "a/.." (must fail)
+(dir-rm-dot) remove "/." (must fail)
+(dir-rm-dot) open "a"
+(dir-rm-dot) unlinkat "./." (must fail)
+(dir-rm-dot) unlinkat "b/.." (must fail)
+(dir-rm-dot) create "a/b/c"
+(dir-rm-dot) end
+EOF
+pass;
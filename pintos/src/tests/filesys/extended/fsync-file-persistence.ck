@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($contents) = join ('', map (chr (ord ('a') + $_ % 26), 0 .. 1233));
+check_archive ({"foo" => [$contents]});
+pass;
@@ -0,0 +1,46 @@
+/* Writes a file, forces it to disk with fsync(), and checks with
+   cachestat() that fsync() wrote the file's dirty sectors back
+   rather than leaving them to shutdown, and that a second fsync()
+   finds nothing left to write.  Runs with the write-behind flusher
+   off (see Make.tests), so that only fsync() writes sectors back.
+   Also checks that fsync() on a bad file descriptor fails. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1234];
+
+/* Data sectors of BUF, all dirty in the cache after writing it. */
+#define DATA_SECTORS ((sizeof buf + 511) / 512)
+
+void
+test_main (void) 
+{
+  struct cache_stat before, after, again;
+  int fd;
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = 'a' + i % 26;
+
+  CHECK (create ("foo", 0), "create \"foo\"");
+  CHECK ((fd = open ("foo")) > 1, "open \"foo\"");
+  CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf,
+         "write \"foo\"");
+  CHECK (cachestat (&before), "cachestat");
+  CHECK (fsync (fd), "fsync \"foo\"");
+  CHECK (cachestat (&after), "cachestat");
+  if (after.write_back_cnt - before.write_back_cnt < DATA_SECTORS)
+    fail ("fsync wrote back %llu sectors, expected at least %zu",
+          after.write_back_cnt - before.write_back_cnt, DATA_SECTORS);
+
+  CHECK (fsync (fd), "fsync \"foo\" again");
+  CHECK (cachestat (&again), "cachestat");
+  if (again.write_back_cnt != after.write_back_cnt)
+    fail ("second fsync wrote back %llu sectors, expected 0",
+          again.write_back_cnt - after.write_back_cnt);
+  CHECK (!fsync (fd + 1), "fsync unopened fd (must fail)");
+  msg ("close \"foo\"");
+  close (fd);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync-file) begin
+(fsync-file) create "foo"
+(fsync-file) open "foo"
+(fsync-file) write "foo"
+(fsync-file) cachestat
+(fsync-file) fsync "foo"
+(fsync-file) cachestat
+(fsync-file) fsync "foo" again
+(fsync-file) cachestat
+(fsync-file) fsync unopened fd (must fail)
+(fsync-file) close "foo"
+(fsync-file) end
+EOF
+pass;
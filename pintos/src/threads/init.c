@@ -37,6 +37,7 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #include "filesys/cache.h"
 #endif
 
@@ -251,6 +252,8 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-extents"))
+        inode_extents = true;
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
@@ -259,6 +262,15 @@ parse_options (char **argv)
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
+      else if (!strcmp (name, "-bcflush"))
+        bc_flush_interval = atoi (value);
+      else if (!strcmp (name, "-bcsize"))
+        bc_size = atoi (value);
+      else if (!strcmp (name, "-bcpolicy"))
+        {
+          if (!bc_set_policy (value))
+            PANIC ("unknown cache policy `%s' (use -h for help)", value);
+        }
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
@@ -379,11 +391,15 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -extents           With -f, format with extent-based inodes.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
+          "  -bcflush=MS        Write back dirty cache every MS ms (0=off).\n"
+          "  -bcsize=N          Cache up to N sectors in buffer cache.\n"
+          "  -bcpolicy=POLICY   Use POLICY (clock, lru, 2q) for buffer cache.\n"
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
@@ -336,3 +336,81 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes readers-writer lock RW.  Any number of readers can
+   hold RW at the same time, or a single writer.  Waiting writers
+   are preferred over new readers, so that a stream of readers
+   cannot starve a writer.  Like locks, RW is not recursive: a
+   thread holding RW must not acquire it again, even for
+   reading, because a writer may have come in between. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->readers);
+  cond_init (&rw->writers);
+  rw->reader_cnt = 0;
+  rw->writer_waiting = 0;
+  rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
+
+  lock_acquire (&rw->lock);
+  while (rw->writer != NULL || rw->writer_waiting > 0)
+    cond_wait (&rw->readers, &rw->lock);
+  rw->reader_cnt++;
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or writer
+   holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
+
+  lock_acquire (&rw->lock);
+  rw->writer_waiting++;
+  while (rw->writer != NULL || rw->reader_cnt > 0)
+    cond_wait (&rw->writers, &rw->lock);
+  rw->writer_waiting--;
+  rw->writer = thread_current ();
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, held by the current thread either for reading or
+   for writing. */
+void
+rwlock_release (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  if (rw->writer == thread_current ())
+    rw->writer = NULL;
+  else
+    {
+      ASSERT (rw->reader_cnt > 0);
+      rw->reader_cnt--;
+    }
+  if (rw->writer_waiting > 0)
+    {
+      if (rw->reader_cnt == 0)
+        cond_signal (&rw->writers, &rw->lock);
+    }
+  else
+    cond_broadcast (&rw->readers, &rw->lock);
+  lock_release (&rw->lock);
+}
@@ -41,6 +41,22 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readers;   /* Readers waiting for writer to leave. */
+    struct condition writers;   /* Writers waiting for lock to be free. */
+    int reader_cnt;             /* Number of readers holding the lock. */
+    int writer_waiting;         /* Number of writers waiting. */
+    struct thread *writer;      /* Writer holding the lock, or NULL. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
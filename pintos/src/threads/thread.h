@@ -127,6 +127,7 @@ struct thread
 
     /* Define current directory. */
     struct dir *directory;		/* Represent current directory. */
+    int bc_pins;			/* Buffer cache entries pinned. */
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
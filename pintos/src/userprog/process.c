@@ -9,7 +9,6 @@
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
 #include "userprog/syscall.h"
-#include "filesys/cache.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -243,9 +242,6 @@ process_exit (void)
   vm_destroy(&cur->vm);
   munmap(EXIT);
 
-  /* Flush all buffer cache to Disk. */
-  bc_flush_all();
-
   /* close all files opened by current process */
   for (i=2; i<64; i++){
     if (cur->fdt[i] != NULL) {
@@ -396,18 +392,15 @@ load (const char *file_name, void (**eip) (void), void **esp)
     goto done;
   process_activate ();
 
-  lock_acquire(&filesys_lock);
   /* Open executable file. */
   file = filesys_open (file_name);
   if (file == NULL) 
     {
-      lock_release(&filesys_lock);
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
   file_deny_write (file);
   thread_current()->running_file = file;
-  lock_release(&filesys_lock);
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
@@ -713,17 +706,12 @@ handle_mm_fault (struct vm_entry *vme)
 {
   struct page *kpage;
   bool success = false;
-  bool have_lock = false;
 
   kpage = get_page (PAL_ZERO | PAL_USER);
   kpage->vme = vme;
   if (kpage == NULL)
     return success;
 
-  /* Acquire filesys_lock for synch. Check if current process already have */
-  if (!lock_held_by_current_thread(&filesys_lock))
-    have_lock = lock_try_acquire(&filesys_lock);
-
   /* Check vm_entry type */
   switch(vme->vp_type) {
     case VP_ELF:
@@ -754,9 +742,6 @@ handle_mm_fault (struct vm_entry *vme)
     pagedir_set_dirty (thread_current()->pagedir, vme->vaddr, true);
   }
 
-  /* Release lock */
-  if(have_lock)
-    lock_release(&filesys_lock);   
   success = true;
 
   done:
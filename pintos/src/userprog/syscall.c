@@ -3,6 +3,7 @@
 #include "userprog/syscall.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <syscall-nr.h>
@@ -11,16 +12,19 @@
 #include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "filesys/cache.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/inode.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "threads/synch.h"
 #include "vm/page.h"
 #include "vm/swap.h"
 
 /* function prototypes */
 static void syscall_handler (struct intr_frame *);
+static int openat_dir (struct dir *, const char *);
 
 /* Check if input is user address. Return corresponding vm_entry */
 static struct vm_entry *
@@ -69,12 +73,11 @@ is_valid_char (const char *str, void *esp)
   }
 }
 
-/* Initialize syscall_handler and filesys_lock */
+/* Initialize syscall_handler */
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  lock_init(&filesys_lock);
 }
 
 /* System call handler functions - Process related */
@@ -142,13 +145,19 @@ open (const char *file)
 {
   /* Open the file corresponds to path in file
      Use struct file *filesys_open(const char *name) */
-  lock_acquire(&filesys_lock);
+  return openat_dir(thread_current()->directory, file);
+}
 
+/* Opens FILE, resolving a relative path from directory BASE, and
+   returns its new fd, or -1 on failure. */
+static int
+openat_dir (struct dir *base, const char *file)
+{
   struct thread *cur = thread_current();
   if (cur->next_fd == 64)
     return -1;
 
-  struct file *f = filesys_open(file);
+  struct file *f = filesys_open_at(base, file);
   if (f == NULL)
     return -1;
   cur->fdt[cur->next_fd] = f;
@@ -169,7 +178,6 @@ filesize(int fd)
 int
 read (int fd, void *buffer, unsigned size)
 {
-  lock_acquire(&filesys_lock);
   if (fd == 0)
     return input_getc();
   else
@@ -179,7 +187,6 @@ read (int fd, void *buffer, unsigned size)
 int
 write (int fd, const void *buffer, unsigned size)
 {
-  lock_acquire(&filesys_lock); 
   if (fd == 1) {
     putbuf((char *)buffer, size);
     return size;
@@ -211,7 +218,6 @@ tell (int fd)
 void
 close (int fd)
 {
-  lock_acquire(&filesys_lock);
   struct thread *cur = thread_current();
   if (cur->fdt[fd] != NULL) {
     file_close(cur->fdt[fd]);
@@ -278,10 +284,8 @@ do_munmap (struct mmap_file *m_file)
     struct vm_entry *vme = list_entry(fr, struct vm_entry, mmap_elem);
     void *addr = vme->vaddr;
     if (pagedir_is_dirty(thread_current()->pagedir, addr)) {
-      lock_acquire(&filesys_lock);
       file_write_at(m_file->file, addr, vme->read_bytes, 
 			vme->offset);
-      lock_release(&filesys_lock);
     }
     list_remove(fr);
     if(pagedir_get_page(thread_current()->pagedir, addr) != NULL)
@@ -392,6 +396,102 @@ inumber (int fd)
   return (int)inode_get_inumber (file_get_inode(file));
 }
 
+/* Writes back every dirty sector of file open as fd (its data, index
+   blocks and inode) to disk before returning, and the free map, which
+   records the sectors allocated to it. Return false if fd is not an open
+   file. */
+bool
+fsync (int fd)
+{
+  struct file *file = process_get_file(fd);
+  if (file == NULL)
+    return false;
+  free_map_sync();
+  inode_flush (file_get_inode(file));
+  return true;
+}
+
+/* Copies buffer cache statistics into st. Statistics are taken into a
+   kernel copy first, since writing st may fault. */
+bool
+cachestat (struct cache_stat *st)
+{
+  struct cache_stat tmp;
+  bc_get_stat (&tmp);
+  memcpy (st, &tmp, sizeof tmp);
+  return true;
+}
+
+/* Reads entries of directory open as fd into ents, at most cnt of them,
+   continuing where the last call stopped. Each entry carries its name,
+   inode number and type. Entries are read into a kernel buffer first,
+   GETDENTS_BATCH at a time, since writing ents may fault. Returns the
+   number of entries read, 0 at end of directory, or -1 if fd is not an
+   open directory. */
+#define GETDENTS_BATCH 8
+
+int
+getdents (int fd, struct dirent *ents, unsigned cnt)
+{
+  struct file *file = process_get_file(fd);
+  struct dirent tmp[GETDENTS_BATCH];
+  unsigned total = 0;
+
+  if (file == NULL || is_inode_file (file_get_inode(file)))
+    return -1;
+  while (total < cnt) {
+    size_t n = dir_getdents((struct dir *) file, tmp,
+                            cnt - total < GETDENTS_BATCH
+                            ? cnt - total : GETDENTS_BATCH);
+    if (n == 0)
+      break;
+    memcpy (ents + total, tmp, n * sizeof *tmp);
+    total += n;
+  }
+  return total;
+}
+
+/* Returns the directory open as fd, or a null pointer if fd is not
+   an open directory. Relies on a directory open through open() being
+   usable as a struct dir, as readdir() does. */
+static struct dir *
+get_dir (int fd)
+{
+  struct file *file = process_get_file(fd);
+  if (file == NULL || is_inode_file (file_get_inode(file)))
+    return NULL;
+  return (struct dir *) file;
+}
+
+/* Opens file, resolving a relative path from the directory open as
+   dirfd instead of the current directory, so that programs working
+   inside one directory do not walk its path again for every file.
+   Returns the new fd, or -1 on failure. */
+int
+openat (int dirfd, const char *file)
+{
+  struct dir *dir = get_dir(dirfd);
+  if (dir == NULL)
+    return -1;
+  return openat_dir(dir, file);
+}
+
+/* Like mkdir(), but resolves a relative path from directory dirfd. */
+bool
+mkdirat (int dirfd, const char *dir)
+{
+  struct dir *base = get_dir(dirfd);
+  return base != NULL && filesys_create_dir_at(base, dir);
+}
+
+/* Like remove(), but resolves a relative path from directory dirfd. */
+bool
+unlinkat (int dirfd, const char *file)
+{
+  struct dir *base = get_dir(dirfd);
+  return base != NULL && filesys_remove_at(base, file);
+}
+
 /* Check valid address of esp, and store argument in arg. */
 static void
 get_argument (void *esp, int *arg, int count)
@@ -462,7 +562,6 @@ syscall_handler (struct intr_frame *f)
       set_page_pflags((void *)arg[0], PAGE_IN_USE);
       f->eax = open((const char *)arg[0]);
       set_page_pflags((void *)arg[0], PAGE_NOT_IN_USE);
-      lock_release(&filesys_lock);
       break;
 
     case SYS_FILESIZE:
@@ -476,7 +575,6 @@ syscall_handler (struct intr_frame *f)
       set_page_pflags((void *)arg[0], PAGE_IN_USE);
       f->eax = read((int)arg[0], (void *)arg[1], (unsigned)arg[2]);
       set_page_pflags((void *)arg[0], PAGE_NOT_IN_USE);
-      lock_release(&filesys_lock);
       break;
 
     case SYS_WRITE:
@@ -485,7 +583,6 @@ syscall_handler (struct intr_frame *f)
       set_page_pflags((void *)arg[0], PAGE_IN_USE);
       f->eax = write((int)arg[0], (const void *)arg[1], (unsigned)arg[2]);
       set_page_pflags((void *)arg[0], PAGE_NOT_IN_USE);
-      lock_release(&filesys_lock);
       break;
 
     case SYS_SEEK:
@@ -501,7 +598,6 @@ syscall_handler (struct intr_frame *f)
     case SYS_CLOSE:
       get_argument(esp, arg, 1);
       close((int)arg[0]);
-      lock_release(&filesys_lock);
       break;
 
     case SYS_MMAP:
@@ -542,6 +638,50 @@ syscall_handler (struct intr_frame *f)
       f->eax = inumber((int)arg[0]);
       break;
 
+    case SYS_FSYNC:
+      get_argument(esp, arg, 1);
+      f->eax = fsync((int)arg[0]);
+      break;
+
+    case SYS_CACHESTAT:
+      get_argument(esp, arg, 1);
+      is_valid_buffer((void *)arg[0], sizeof(struct cache_stat), esp);
+      f->eax = cachestat((struct cache_stat *)arg[0]);
+      break;
+
+    case SYS_OPENAT:
+      get_argument(esp, arg, 2);
+      is_valid_char((const char *)arg[1], esp);
+      set_page_pflags((void *)arg[1], PAGE_IN_USE);
+      f->eax = openat((int)arg[0], (const char *)arg[1]);
+      set_page_pflags((void *)arg[1], PAGE_NOT_IN_USE);
+      break;
+
+    case SYS_MKDIRAT:
+      get_argument(esp, arg, 2);
+      is_valid_char((const char *)arg[1], esp);
+      f->eax = mkdirat((int)arg[0], (const char *)arg[1]);
+      break;
+
+    case SYS_UNLINKAT:
+      get_argument(esp, arg, 2);
+      is_valid_char((const char *)arg[1], esp);
+      set_page_pflags((void *)arg[1], PAGE_IN_USE);
+      f->eax = unlinkat((int)arg[0], (const char *)arg[1]);
+      set_page_pflags((void *)arg[1], PAGE_NOT_IN_USE);
+      break;
+
+    case SYS_GETDENTS:
+      get_argument(esp, arg, 3);
+      /* A buffer whose size overflows cannot be valid user memory. */
+      if ((unsigned)arg[2] > UINT_MAX / sizeof(struct dirent))
+        exit(-1);
+      is_valid_buffer((void *)arg[1], (unsigned)arg[2] * sizeof(struct dirent),
+                      esp);
+      f->eax = getdents((int)arg[0], (struct dirent *)arg[1],
+                        (unsigned)arg[2]);
+      break;
+
     default:
       break;
 
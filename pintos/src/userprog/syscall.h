@@ -2,6 +2,8 @@
 #define USERPROG_SYSCALL_H
 
 
+#include <cache-stat.h>
+#include <dirent.h>
 #include "vm/page.h"
 #include "threads/synch.h"
 
@@ -11,8 +13,6 @@
 typedef int pid_t;
 typedef int mapid_t;
 
-struct lock filesys_lock;
-
 void syscall_init (void);
 
 /* Project 2 */
@@ -42,4 +42,12 @@ bool readdir (int, char *);
 bool isdir (int);
 int inumber (int);
 
+/* Extensions */
+bool fsync (int);
+bool cachestat (struct cache_stat *);
+int getdents (int, struct dirent *, unsigned);
+int openat (int, const char *);
+bool mkdirat (int, const char *);
+bool unlinkat (int, const char *);
+
 #endif /* userprog/syscall.h */
@@ -1,5 +1,6 @@
 #include "vm/swap.h"
 #include "devices/block.h"
+#include "filesys/cache.h"
 #include "lib/debug.h"
 #include "lib/stdbool.h"
 #include "lib/stddef.h"
@@ -29,15 +30,17 @@ lru_init (void)
 }
 
 /* Get page using palloc_get_page, if no available page to allocate, 
-   Swap out current page and allocate new page and initialize page 
-   structure. Return pointer to newly allocated page structure */
+   shrink buffer cache, or if it cannot shrink any more, Swap out current
+   page and allocate new page and initialize page structure. Return pointer
+   to newly allocated page structure */
 struct page *
 get_page (enum palloc_flags flag)
 {
   void *addr = palloc_get_page(flag);
-  /* Allocation failed - swap out */
+  /* Allocation failed - shrink buffer cache or swap out */
   while (addr == NULL) {
-    swap_out();
+    if (!bc_shrink())
+      swap_out();
     addr = palloc_get_page(flag);
   }
 
@@ -170,9 +173,7 @@ swap_out (void)
       break;
     case VP_FILE:
       if (pagedir_is_dirty(victim->thread->pagedir, vaddr)) {
-        lock_acquire(&filesys_lock);
         file_write_at(vme->file, vaddr, vme->read_bytes, vme->offset);
-        lock_release(&filesys_lock);
       }
       break;
     case VP_SWAP: